@@ -0,0 +1,446 @@
+/*
+ * Native benchmark for Tree RCU grace-period latency.
+ *
+ * This test cannot be run under Nidhugg. It has to be compiled with
+ * -DNATIVE, and interrupts have to be modeled with separate threads
+ * (-DIRQ_THREADS), e.g.:
+ *
+ *	gcc -Iv4.9.6 -O2 -fno-strict-aliasing -std=gnu99 -DNATIVE \
+ *	    -DIRQ_THREADS -DCONFIG_NR_CPUS=8 bench.c -pthread
+ *
+ * CPU 0 hosts the grace-period kthreads of all flavors, while every other
+ * CPU runs an updater which calls synchronize_rcu() BENCH_LOOPS times. At
+ * the end, the latency of synchronize_rcu() as seen by the updaters is
+ * reported, along with the host CPU time consumed, the tick statistics,
+ * the lock statistics of rcu_sched and the statistics of the kthreads.
+ *
+ * What the updaters measure:
+ *   -DBENCH_BH           synchronize_rcu_bh(), and the rcu_bh statistics
+ *   -DBENCH_EXPEDITED    synchronize_sched_expedited(), and the IPI and
+ *                        workqueue statistics
+ *   -DBENCH_FLOOD=n      also the latency of n callbacks posted before each
+ *                        call, and the softirq, batch and slab statistics
+ *   -DBENCH_KFREE        with -DBENCH_FLOOD, callbacks posted by
+ *                        kfree_rcu(), up to their kfree()
+ *
+ * What else the emulated machine does meanwhile:
+ *   -DBENCH_READERS=n    the last n CPUs run busy readers, which pass
+ *                        through a quiescent state every BENCH_READ_BATCH
+ *                        critical sections, instead of updaters
+ *   -DBENCH_HOTPLUG      a kthread on CPU 0 keeps cycling the other CPUs
+ *                        offline and online (see fake_hotplug.h); calls
+ *                        that overlapped a transition are reported apart
+ *   -DBENCH_NMI          every online CPU takes NMI_HZ NMIs per second
+ *                        (see fake_nmi.h), and their cost is reported
+ *
+ * How it runs (see README.md, and the header named for each):
+ *   -DFIBERS             as fibers over a few host threads (fake_fiber.h)
+ *   -DSIMULATE           in virtual time (fake_sim.h), which also reports
+ *                        the latency distribution
+ *   -DPCT                under a randomized priority scheduler (fake_pct.h)
+ *   -DPIN_CPUS           pinned to host CPUs (fake_topology.h)
+ *   -DATOMIC_STATS       reporting atomics by call site (fake_native.h)
+ *
+ * The tick rate is set by -DCONFIG_HZ=x and jittered by -DTICK_JITTER_US=x,
+ * the FQS intervals by -DFIRST_FQS_JIFFIES=x and -DNEXT_FQS_JIFFIES=x, and
+ * the batch limits of rcu_do_batch() by -DBLIMIT=x, -DQHIMARK=x and
+ * -DQLOWMARK=x.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef NATIVE
+# error "bench.c can only be compiled with -DNATIVE"
+#endif
+#if (defined(FIBERS) || defined(SIMULATE)) && defined(BENCH_NMI)
+# error "NMIs cannot be injected into fibers"
+#endif
+#if defined(BENCH_KFREE) && !defined(BENCH_FLOOD)
+# error "-DBENCH_KFREE needs -DBENCH_FLOOD=n"
+#endif
+
+#include "fake_defs.h"
+#include "fake_sync.h"
+#include <linux/rcupdate.h>
+#include <update.c>
+#include "tree.c"
+#include "fake_sched.h"
+
+#ifndef BENCH_LOOPS
+# define BENCH_LOOPS 100
+#endif
+
+#ifndef BENCH_READERS
+# define BENCH_READERS 0
+#endif
+#ifndef BENCH_READ_BATCH
+# define BENCH_READ_BATCH 1000
+#endif
+#define BENCH_UPDATERS (NR_CPUS - 1 - BENCH_READERS)
+
+#ifdef BENCH_EXPEDITED
+# define bench_sync() synchronize_sched_expedited()
+# define BENCH_SYNC_NAME "synchronize_sched_expedited()"
+#elif defined(BENCH_BH)
+# define bench_sync() synchronize_rcu_bh()
+# define BENCH_SYNC_NAME "synchronize_rcu_bh()"
+#else
+# define bench_sync() synchronize_rcu()
+# define BENCH_SYNC_NAME "synchronize_rcu()"
+#endif
+
+#ifdef BENCH_BH
+# define bench_rsp (&rcu_bh_state)
+# define bench_call(head, func) call_rcu_bh(head, func)
+#else
+# define bench_rsp (&rcu_sched_state)
+# define bench_call(head, func) call_rcu(head, func)
+#endif
+
+int cpus[NR_CPUS];
+
+#ifdef BENCH_FLOOD
+struct bench_cb {
+	struct rcu_head rh;
+	u64 posted;
+};
+
+/* Callback latencies */
+unsigned long cb_n;
+u64 cb_sum;
+u64 cb_max;
+
+void bench_cb_done(struct bench_cb *cb)
+{
+	u64 lat = fake_clock_ns() - cb->posted;
+	u64 max = __atomic_load_n(&cb_max, __ATOMIC_RELAXED);
+
+	while (lat > max &&
+	       !__atomic_compare_exchange_n(&cb_max, &max, lat, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	__atomic_fetch_add(&cb_sum, lat, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&cb_n, 1, __ATOMIC_RELEASE);
+}
+
+void bench_cb_func(struct rcu_head *rh)
+{
+	struct bench_cb *cb = container_of(rh, struct bench_cb, rh);
+
+	bench_cb_done(cb);
+	kfree(cb);
+}
+
+void bench_flood(void)
+{
+	struct bench_cb *cb;
+	int i;
+
+	for (i = 0; i < BENCH_FLOOD; i++) {
+		cb = kmalloc(sizeof(*cb), GFP_KERNEL);
+		cb->posted = fake_clock_ns();
+#ifdef BENCH_KFREE
+		kfree_rcu(cb, rh);
+#else
+		bench_call(&cb->rh, bench_cb_func);
+#endif
+	}
+}
+#endif
+
+/*
+ * Memory is freed to the slab allocator of fake_slab.h. With -DBENCH_KFREE,
+ * the flood's callbacks are kfree_rcu() ones, which only get here.
+ */
+void kfree(const void *p)
+{
+#ifdef BENCH_KFREE
+	bench_cb_done((struct bench_cb *) p);
+#endif
+	fake_kfree(p);
+}
+
+/* bench_sync() latencies, per updater */
+u64 gp_min[NR_CPUS];
+u64 gp_max[NR_CPUS];
+u64 gp_sum[NR_CPUS];
+#ifdef BENCH_HOTPLUG
+/* Same, for the calls disturbed by CPU hotplug */
+u64 gp_hp_max[NR_CPUS];
+u64 gp_hp_sum[NR_CPUS];
+unsigned long gp_hp_n[NR_CPUS];
+#endif
+#ifdef SIMULATE
+/* Histogram of the bench_sync() latencies, four buckets per power of two */
+unsigned long gp_hist[256];
+
+static int gp_bucket(u64 ns)
+{
+	int order;
+
+	if (ns < 4)
+		return ns;
+	order = 63 - __builtin_clzll(ns);
+	return 4 * (order - 1) + ((ns >> (order - 2)) & 3);
+}
+
+/* Lower bound of a bucket */
+static u64 gp_bucket_ns(int bucket)
+{
+	if (bucket < 4)
+		return bucket;
+	return (u64) (4 + bucket % 4) << (bucket / 4 - 1);
+}
+#endif
+
+void *thread_update(void *arg)
+{
+	int cpu = *(int *) arg;
+	u64 start, delta;
+#ifdef BENCH_HOTPLUG
+	unsigned int ev;
+#endif
+	int i;
+
+	set_cpu(cpu);
+	fake_acquire_cpu(get_cpu());
+
+	gp_min[cpu] = ULLONG_MAX;
+	for (i = 0; i < BENCH_LOOPS; i++) {
+#ifdef BENCH_HOTPLUG
+		ev = READ_ONCE(fake_hotplug_events);
+#endif
+#ifdef BENCH_FLOOD
+		bench_flood();
+#endif
+		start = fake_clock_ns();
+		bench_sync();
+		delta = fake_clock_ns() - start;
+#ifdef BENCH_HOTPLUG
+		if ((ev & 1) || READ_ONCE(fake_hotplug_events) != ev) {
+			gp_hp_n[cpu]++;
+			gp_hp_sum[cpu] += delta;
+			if (delta > gp_hp_max[cpu])
+				gp_hp_max[cpu] = delta;
+		}
+#endif
+		gp_sum[cpu] += delta;
+		if (delta < gp_min[cpu])
+			gp_min[cpu] = delta;
+		if (delta > gp_max[cpu])
+			gp_max[cpu] = delta;
+#ifdef SIMULATE
+		__atomic_fetch_add(&gp_hist[gp_bucket(delta)], 1,
+				   __ATOMIC_RELAXED);
+#endif
+		cond_resched();
+	}
+
+	fake_release_cpu(get_cpu());
+	return NULL;
+}
+
+int bench_done;
+int readers_running;
+unsigned long reads[NR_CPUS];
+
+void *thread_read(void *arg)
+{
+	int cpu = *(int *) arg;
+	int i;
+
+	set_cpu(cpu);
+	fake_acquire_cpu(get_cpu());
+	__atomic_fetch_add(&readers_running, 1, __ATOMIC_RELAXED);
+
+	while (!READ_ONCE(bench_done)) {
+		for (i = 0; i < BENCH_READ_BATCH; i++) {
+			rcu_read_lock_sched();
+			reads[cpu]++;
+			rcu_read_unlock_sched();
+		}
+		cond_resched();
+#ifdef PCT
+		/* cond_resched() does not yield then, but this loop spins */
+		sched_yield();
+#endif
+	}
+
+	fake_release_cpu(get_cpu());
+	return NULL;
+}
+
+int main()
+{
+	pthread_t tu[NR_CPUS];
+	u64 min = ULLONG_MAX, max = 0, sum = 0;
+	u64 start, elapsed, cpu_time, nr_reads = 0;
+#ifdef BENCH_HOTPLUG
+	u64 hp_max = 0, hp_sum = 0;
+	unsigned long hp_n = 0;
+#endif
+#ifdef SIMULATE
+	int j;
+#endif
+	unsigned long start_jiffies, start_gp;
+	int i;
+
+	BUILD_BUG_ON(BENCH_UPDATERS < 1);
+
+	/* Initialize cpu_possible_mask, cpu_online_mask */
+	set_online_cpus();
+	set_possible_cpus();
+#ifdef FIRST_FQS_JIFFIES
+	jiffies_till_first_fqs = FIRST_FQS_JIFFIES;
+#endif
+#ifdef NEXT_FQS_JIFFIES
+	jiffies_till_next_fqs = NEXT_FQS_JIFFIES;
+#endif
+#ifdef BLIMIT
+	blimit = BLIMIT;
+#endif
+#ifdef QHIMARK
+	qhimark = QHIMARK;
+#endif
+#ifdef QLOWMARK
+	qlowmark = QLOWMARK;
+#endif
+	/* RCU initializations */
+	rcu_init();
+	/* All CPUs start out idle -- IRQ threads are spawned */
+	for (i = 0; i < NR_CPUS; i++) {
+		set_cpu(i);
+		rcu_cpu_starting(i);
+		rcu_idle_enter();
+		spawn_irq_kthread(i);
+	}
+	/* Spawn threads -- the readers are up and running first */
+	for (i = BENCH_UPDATERS + 1; i < NR_CPUS; i++) {
+		cpus[i] = i;
+		if (pthread_create(&tu[i], NULL, thread_read, &cpus[i]))
+			abort();
+	}
+	while (READ_ONCE(readers_running) < BENCH_READERS)
+		sched_yield();
+	start = fake_clock_ns();
+	start_jiffies = jiffies;
+	start_gp = bench_rsp->completed;
+	cpu_time = fake_process_cpu_ns();
+	rcu_spawn_gp_kthread();
+	for (i = 1; i <= BENCH_UPDATERS; i++) {
+		cpus[i] = i;
+		if (pthread_create(&tu[i], NULL, thread_update, &cpus[i]))
+			abort();
+	}
+#ifdef BENCH_HOTPLUG
+	fake_start_hotplug();
+#endif
+#ifdef BENCH_NMI
+	fake_start_nmi();
+#endif
+	for (i = 1; i <= BENCH_UPDATERS; i++) {
+		if (pthread_join(tu[i], NULL))
+			abort();
+		sum += gp_sum[i];
+		if (gp_min[i] < min)
+			min = gp_min[i];
+		if (gp_max[i] > max)
+			max = gp_max[i];
+#ifdef BENCH_HOTPLUG
+		hp_n += gp_hp_n[i];
+		hp_sum += gp_hp_sum[i];
+		if (gp_hp_max[i] > hp_max)
+			hp_max = gp_hp_max[i];
+#endif
+	}
+	elapsed = fake_clock_ns() - start;
+	cpu_time = fake_process_cpu_ns() - cpu_time;
+#ifdef BENCH_NMI
+	fake_stop_nmi();
+#endif
+	WRITE_ONCE(bench_done, 1);
+	for (; i < NR_CPUS; i++) {
+		if (pthread_join(tu[i], NULL))
+			abort();
+		nr_reads += reads[i];
+	}
+#ifdef BENCH_FLOOD
+	/* Let the callbacks drain */
+	while (__atomic_load_n(&cb_n, __ATOMIC_ACQUIRE) <
+	       BENCH_UPDATERS * BENCH_LOOPS * BENCH_FLOOD)
+		fake_sleep_until(fake_clock_ns() + 1000000ULL);
+#endif
+	fake_stop_kthreads();
+
+	printf("CPUs %d, updaters %d, updates %d, readers %d, reads %llu\n",
+	       NR_CPUS, BENCH_UPDATERS, BENCH_UPDATERS * BENCH_LOOPS,
+	       BENCH_READERS, nr_reads);
+	printf("%s latency: min %llu avg %llu max %llu ns\n",
+	       BENCH_SYNC_NAME, min, sum / (BENCH_UPDATERS * BENCH_LOOPS), max);
+#ifdef SIMULATE
+	for (j = 0; j < 255; j++)
+		if (gp_hist[j])
+			printf("  [%12llu, %12llu) ns %10lu\n", gp_bucket_ns(j),
+			       gp_bucket_ns(j + 1), gp_hist[j]);
+#endif
+#ifdef BENCH_HOTPLUG
+	printf("%lu calls disturbed by hotplug: avg %llu max %llu ns, undisturbed avg %llu ns\n",
+	       hp_n, hp_n ? hp_sum / hp_n : 0, hp_max,
+	       hp_n < BENCH_UPDATERS * BENCH_LOOPS ?
+	       (sum - hp_sum) / (BENCH_UPDATERS * BENCH_LOOPS - hp_n) : 0);
+#endif
+	printf("grace periods %lu, FQS scans %lu, jiffies %lu, FQS delays %lu/%lu\n",
+	       bench_rsp->completed - start_gp, bench_rsp->n_force_qs,
+	       jiffies - start_jiffies, jiffies_till_first_fqs,
+	       jiffies_till_next_fqs);
+	printf("elapsed %llu ns, host CPU time %llu ns (%.2f host CPUs)\n",
+	       elapsed, cpu_time, (double) cpu_time / elapsed);
+	fake_dump_tick_stats(elapsed);
+	fake_dump_lock_stats(bench_rsp);
+	fake_dump_kthread_stats();
+#ifdef BENCH_EXPEDITED
+	fake_dump_ipi_stats();
+	fake_dump_workqueue_stats();
+#endif
+#ifdef BENCH_HOTPLUG
+	fake_dump_hotplug_stats();
+#endif
+#ifdef BENCH_FLOOD
+	printf("callbacks %lu, latency avg %llu max %llu ns\n", cb_n,
+	       cb_sum / cb_n, cb_max);
+	fake_dump_softirq_stats(elapsed);
+	fake_dump_kmem_stats();
+#endif
+#ifdef BENCH_NMI
+	fake_dump_nmi_stats();
+#endif
+#ifdef FIBERS
+	fake_dump_fiber_stats();
+#endif
+#ifdef SIMULATE
+	fake_dump_sim_stats();
+#endif
+#ifdef PIN_CPUS
+	fake_dump_topology();
+#endif
+#ifdef ATOMIC_STATS
+	fake_dump_atomic_stats();
+#endif
+#ifdef PCT
+	fake_dump_pct_stats();
+#endif
+
+	return 0;
+}
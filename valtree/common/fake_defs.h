@@ -0,0 +1,1541 @@
+/*
+ * "Fake" declarations to scaffold a Linux-kernel SMP environment.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ *
+ * Author: Michalis Kokologiannakis <mixaskok@gmail.com>
+ */
+
+#ifndef __FAKE_DEFS_H
+#define __FAKE_DEFS_H
+
+/*
+ * This emulation runtime is shared by all kernel trees. The fake_defs.h of
+ * each tree sets LINUX_VERSION_CODE and maps the RCU hooks of the emulated
+ * scheduler (see below) to the API of its kernel version, and then
+ * includes this file. Definitions that only exist in some versions, or
+ * that the verification results of a tree depend on, are guarded by
+ * LINUX_VERSION_CODE; everything else, in particular the whole native
+ * backend, is the same for all trees.
+ */
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+
+#ifndef LINUX_VERSION_CODE
+# error "LINUX_VERSION_CODE has to be set by the fake_defs.h of the kernel tree"
+#endif
+#if defined(NATIVE) && LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0)
+# error "Native runs need the grace-period kthreads of v3.19 and later"
+#endif
+
+/*
+ * RCU hooks of the emulated scheduler: the CPU goes idle, comes out of
+ * idle, passes through a context switch, and takes a scheduling-clock
+ * interrupt (user is nonzero if it interrupted user mode). The defaults
+ * are those of v3.19 and later.
+ */
+#ifndef fake_rcu_idle_enter
+# define fake_rcu_idle_enter() rcu_idle_enter()
+#endif
+#ifndef fake_rcu_idle_exit
+# define fake_rcu_idle_exit() rcu_idle_exit()
+#endif
+#ifndef fake_rcu_note_context_switch
+# define fake_rcu_note_context_switch() rcu_note_context_switch()
+#endif
+#ifndef fake_rcu_check_callbacks
+# define fake_rcu_check_callbacks(user) rcu_check_callbacks(user)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+#ifdef NATIVE
+# include <stdarg.h>
+# include <time.h>
+# include <unistd.h>
+# include <sys/syscall.h>
+#endif
+
+/* Definitions taken from the Linux Kernel (v.2.6.31.1 to v.4.9.6) */
+
+#define __force
+#define __kernel
+#define notrace
+
+#undef offsetof
+#ifdef __compiler_offsetof
+#define offsetof(TYPE,MEMBER) __compiler_offsetof(TYPE,MEMBER)
+#else
+#define offsetof(TYPE, MEMBER) ((size_t) &((TYPE *)0)->MEMBER)
+#endif
+
+#define container_of(ptr, type, member) ({				\
+			const __typeof__( ((type *)0)->member ) *__mptr = (ptr); \
+			(type *)( (char *)__mptr - offsetof(type,member) );})
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(*(x)))
+
+/*
+ * Getting something that works in C and CPP for an arg that may or may
+ * not be defined is tricky.  Here, if we have "#define CONFIG_BOOGER 1"
+ * we match on the placeholder define, insert the "0," for arg1 and generate
+ * the triplet (0, 1, 0).  Then the last step cherry picks the 2nd arg (a one).
+ * When CONFIG_BOOGER is not defined, we generate a (... 1, 0) pair, and when
+ * the last step cherry picks the 2nd arg, we get a zero.
+ */
+#define __ARG_PLACEHOLDER_1 0,
+#define config_enabled(cfg) _config_enabled(cfg)
+#define _config_enabled(value) __config_enabled(__ARG_PLACEHOLDER_##value)
+#define __config_enabled(arg1_or_junk) ___config_enabled(arg1_or_junk 1, 0)
+#define ___config_enabled(__ignored, val, ...) val
+
+/*
+ * IS_ENABLED(CONFIG_FOO) evaluates to 1 if CONFIG_FOO is set to 'y' or 'm',
+ * 0 otherwise.
+ *
+ */
+#define IS_ENABLED(option)						\
+	(config_enabled(option) || config_enabled(option##_MODULE))
+
+#ifndef __maybe_unused
+# ifdef NATIVE
+#  define __maybe_unused __attribute__((__unused__))
+# else
+#  define __maybe_unused         /* unimplemented */
+# endif
+#endif
+
+/*
+ * Check at compile time that something is of a particular type.
+ * Always evaluates to 1 so you may use it easily in comparisons.
+ */
+#define typecheck(type,x) \
+({      type __dummy; \
+        typeof(x) __dummy2; \
+        (void)(&__dummy == &__dummy2); \
+        1; \
+})
+
+/* Optimization barrier */
+/* The "volatile" is due to gcc bugs */
+#define barrier() __asm__ volatile("": : :"memory")
+
+/* Other barriers -- x86 and powerpc config */
+#ifdef POWERPC
+# define __stringify_in_c(...) #__VA_ARGS__
+# define stringify_in_c(...)   __stringify_in_c(__VA_ARGS__) " "
+
+# define mb()   __asm__ __volatile__ ("sync" : : : "memory")
+# define rmb()  __asm__ __volatile__ ("sync" : : : "memory")
+# define wmb()  __asm__ __volatile__ ("sync" : : : "memory")
+
+# define SMPWMB      eieio
+# define LWSYNC      sync
+
+# define __lwsync()      __asm__ __volatile__ (stringify_in_c(LWSYNC) : : :"memory")
+# define dma_rmb()       __lwsync()
+# define dma_wmb()       __asm__ __volatile__ (stringify_in_c(SMPWMB) : : :"memory")
+
+# define smp_lwsync()    __lwsync()
+
+# define smp_mb()        mb()
+# define smp_rmb()       __lwsync()
+# define smp_wmb()       __asm__ __volatile__ (stringify_in_c(SMPWMB) : : :"memory")
+
+# define read_barrier_depends()          do { } while (0)
+# define smp_read_barrier_depends()      do { } while (0)
+
+# define smp_store_release(p, v)					\
+do {                                                                    \
+        smp_lwsync();                                                   \
+        ACCESS_ONCE(*p) = (v);                                          \
+} while (0)
+
+# define smp_load_acquire(p)						\
+({                                                                      \
+        typeof(*p) ___p1 = ACCESS_ONCE(*p);                             \
+									\
+        smp_lwsync();                                                   \
+        ___p1;                                                          \
+})
+
+# define smp_mb__before_atomic()     smp_mb()
+# define smp_mb__after_atomic()      smp_mb()
+#elif PSO /* #ifdef POWERPC */
+# define mb()    __asm__ volatile("mfence":::"memory")
+# define rmb()   __asm__ volatile("lfence":::"memory")
+# define wmb()   __asm__ volatile("sfence" ::: "memory")
+
+# define dma_rmb()       barrier()
+# define dma_wmb()       barrier()
+
+# define smp_mb()        mb()
+# define smp_rmb()       dma_rmb()
+# define smp_wmb()       mb()
+
+# define read_barrier_depends()          do { } while (0)
+# define smp_read_barrier_depends()      do { } while (0)
+
+# define smp_store_release(p, v)			\
+	do {						\
+		barrier();				\
+		smp_mb();				\
+		ACCESS_ONCE(*p) = (v);			\
+	} while (0)
+
+# define smp_load_acquire(p)				\
+	({						\
+		__typeof__(*p) ___p1 = ACCESS_ONCE(*p);	\
+							\
+		barrier();				\
+		___p1;					\
+	})
+
+# define smp_mb__before_atomic() smp_mb()
+# define smp_mb__after_atomic()  smp_mb()
+
+# define smp_mb__after_unlock_lock()     do { } while (0)
+#else /* #ifdef POWERPC */
+# define mb()    __asm__ volatile("mfence":::"memory")
+# define rmb()   __asm__ volatile("lfence":::"memory")
+# define wmb()   __asm__ volatile("sfence" ::: "memory")
+
+# define dma_rmb()       barrier()
+# define dma_wmb()       barrier()
+
+# define smp_mb()        mb()
+# define smp_rmb()       dma_rmb()
+# define smp_wmb()       barrier()
+
+# define read_barrier_depends()          do { } while (0)
+# define smp_read_barrier_depends()      do { } while (0)
+
+# define smp_store_release(p, v)			\
+	do {						\
+		barrier();				\
+		ACCESS_ONCE(*p) = (v);			\
+	} while (0)
+
+# define smp_load_acquire(p)				\
+	({						\
+		__typeof__(*p) ___p1 = ACCESS_ONCE(*p);	\
+							\
+		barrier();				\
+		___p1;					\
+	})
+
+# define smp_mb__before_atomic() barrier()
+# define smp_mb__after_atomic()  barrier()
+
+# define smp_mb__after_unlock_lock()     do { } while (0)
+#endif /* #ifdef POWERPC */
+
+/* Older names of smp_mb__before_atomic() and smp_mb__after_atomic() */
+#define smp_mb__before_atomic_inc() smp_mb__before_atomic()
+#define smp_mb__after_atomic_inc()  smp_mb__after_atomic()
+
+/* Atomic data types */
+typedef struct {
+	int counter;
+} atomic_t;
+
+typedef struct {
+	long counter;
+} atomic_long_t;
+
+#define ATOMIC_INIT(i)  { (i) }
+
+/* Boolean data types */
+typedef _Bool bool;
+
+enum {
+	false	= 0,
+	true	= 1
+};
+
+/* Integer types */
+typedef unsigned long ulong;
+
+typedef signed char s8;
+typedef unsigned char u8;
+
+typedef signed short s16;
+typedef unsigned short u16;
+
+typedef signed int s32;
+typedef unsigned int u32;
+
+typedef signed long long s64;
+typedef unsigned long long u64;
+
+#define USHRT_MAX	((u16)(~0U))
+#define SHRT_MAX	((s16)(USHRT_MAX>>1))
+#define SHRT_MIN	((s16)(-SHRT_MAX - 1))
+#define INT_MAX		((int)(~0U>>1))
+#define INT_MIN		(-INT_MAX - 1)
+#define UINT_MAX	(~0U)
+#define LONG_MAX	((long)(~0UL>>1))
+#define LONG_MIN	(-LONG_MAX - 1)
+#define ULONG_MAX	(~0UL)
+#define LLONG_MAX	((long long)(~0ULL>>1))
+#define LLONG_MIN	(-LLONG_MAX - 1)
+#define ULLONG_MAX	(~0ULL)
+#define SIZE_MAX	(~(size_t)0)
+
+#define U8_MAX		((u8)~0U)
+#define S8_MAX		((s8)(U8_MAX>>1))
+#define S8_MIN		((s8)(-S8_MAX - 1))
+#define U16_MAX		((u16)~0U)
+#define S16_MAX		((s16)(U16_MAX>>1))
+#define S16_MIN		((s16)(-S16_MAX - 1))
+#define U32_MAX		((u32)~0U)
+#define S32_MAX		((s32)(U32_MAX>>1))
+#define S32_MIN		((s32)(-S32_MAX - 1))
+#define U64_MAX		((u64)~0ULL)
+#define S64_MAX		((s64)(U64_MAX>>1))
+#define S64_MIN		((s64)(-S64_MAX - 1))
+
+/* ACCESS_ONCE(), READ_ONCE(), WRITE_ONCE() and relatives */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0)
+#define __ACCESS_ONCE(x) ({ \
+         __maybe_unused typeof(x) __var = (__force typeof(x)) 0; \
+         (volatile typeof(x) *)&(x); })
+#define ACCESS_ONCE(x) (*__ACCESS_ONCE(x))
+#else
+#define __ACCESS_ONCE(x) ((volatile __typeof__(x) *)&(x))
+#define ACCESS_ONCE(x) (*(volatile __typeof__(x) *)&(x))
+#endif
+
+#define ACCESS_PRIVATE(p, member) ((p)->member)
+
+static __always_inline void __write_once_size(volatile void *p, void *res, int size)
+{
+        switch (size) {
+        case 1: *(volatile u8 *)p = *(u8 *)res; break;
+        case 2: *(volatile u16 *)p = *(u16 *)res; break;
+        case 4: *(volatile u32 *)p = *(u32 *)res; break;
+        case 8: *(volatile u64 *)p = *(u64 *)res; break;
+        default:
+                barrier();
+                __builtin_memcpy((void *)p, (const void *)res, size);
+                barrier();
+        }
+}
+
+#define __READ_ONCE_SIZE                                                \
+({                                                                      \
+        switch (size) {                                                 \
+        case 1: *(u8 *)res = *(volatile u8 *)p; break;              \
+        case 2: *(u16 *)res = *(volatile u16 *)p; break;            \
+        case 4: *(u32 *)res = *(volatile u32 *)p; break;            \
+        case 8: *(u64 *)res = *(volatile u64 *)p; break;            \
+        default:                                                        \
+                barrier();                                              \
+                __builtin_memcpy((void *)res, (const void *)p, size);		\
+                barrier();                                              \
+        }                                                               \
+})
+
+static __always_inline
+void __read_once_size(const volatile void *p, void *res, int size)
+{
+        __READ_ONCE_SIZE;
+}
+
+static __always_inline
+void __read_once_size_nocheck(const volatile void *p, void *res, int size)
+{
+        __READ_ONCE_SIZE;
+}
+
+#define __READ_ONCE(x, check)                                           \
+({                                                                      \
+        union { typeof(x) __val; char __c[1]; } __u;                    \
+        if (check)                                                      \
+                __read_once_size(&(x), __u.__c, sizeof(x));             \
+        else                                                            \
+                __read_once_size_nocheck(&(x), __u.__c, sizeof(x));     \
+        __u.__val;                                                      \
+})
+#define READ_ONCE(x) __READ_ONCE(x, 1)
+
+/*
+ * Use READ_ONCE_NOCHECK() instead of READ_ONCE() if you need
+ * to hide memory access from KASAN.
+ */
+#define READ_ONCE_NOCHECK(x) __READ_ONCE(x, 0)
+
+#define __WRITE_ONCE(x, val) \
+({                                                      \
+        union { typeof(x) __val; char __c[1]; } __u =   \
+                { .__val = (__force typeof(x)) (val) }; \
+        __write_once_size(&(x), __u.__c, sizeof(x));    \
+        __u.__val;                                      \
+})
+#define WRITE_ONCE(x, val) __WRITE_ONCE(x, val)
+
+#ifdef PCT
+/* Natively, with -DPCT, marked accesses are preemption points */
+void fake_pct_point(void);
+# undef ACCESS_ONCE
+# define ACCESS_ONCE(x) (*({ fake_pct_point(); __ACCESS_ONCE(x); }))
+# undef READ_ONCE
+# define READ_ONCE(x) ({ fake_pct_point(); __READ_ONCE(x, 1); })
+# undef WRITE_ONCE
+# define WRITE_ONCE(x, val) ({ fake_pct_point(); __WRITE_ONCE(x, val); })
+#endif
+
+/* Integer division that rounds up */
+#define DIV_ROUND_UP(n,d) (((n) + (d) - 1) / (d))
+
+/* A very rough approximation to the sqrt() function. */
+#define BITS_PER_LONG (sizeof(long) * 8)
+unsigned long int_sqrt(unsigned long x)
+{
+        unsigned long b, m, y = 0;
+
+        if (x <= 1)
+                return x;
+
+        m = 1UL << (BITS_PER_LONG - 2);
+        while (m != 0) {
+                b = y + m;
+                y >>= 1;
+
+                if (x >= b) {
+                        x -= b;
+                        y += m;
+                }
+                m >>= 2;
+        }
+
+        return y;
+}
+
+/* Indirect stringification.  Doing two levels allows the parameter to be a
+ * macro itself.  For example, compile with -DFOO=bar, __stringify(FOO)
+ * converts to "bar".
+ */
+#define __stringify_1(x...)     #x
+#define __stringify(x...)       __stringify_1(x)
+
+/**
+ * struct callback_head - callback structure for use with RCU and task_work
+ * @next: next update requests in a list
+ * @func: actual update function to call after the grace period.
+ * Before v3.19, rcupdate.h defines struct rcu_head itself.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 19, 0)
+struct callback_head {
+	struct callback_head *next;
+	void (*func)(struct callback_head *head);
+};
+#define rcu_head callback_head
+#endif
+
+/* Before v4.3, rcupdate.h defines call_rcu_func_t itself */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0)
+typedef void (*rcu_callback_t)(struct rcu_head *head);
+typedef void (*call_rcu_func_t)(struct rcu_head *head, rcu_callback_t func);
+#endif
+
+/* List data types definitions and functions */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+
+#define LIST_HEAD(name)					\
+	struct list_head name = LIST_HEAD_INIT(name)
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+	list->next = list;
+	list->prev = list;
+}
+
+static inline void __list_add(struct list_head *new,
+                              struct list_head *prev,
+                              struct list_head *next)
+{
+        next->prev = new;
+        new->next = next;
+        new->prev = prev;
+        prev->next = new;
+}
+
+static inline void list_add(struct list_head *new, struct list_head *head)
+{
+        __list_add(new, head, head->next);
+}
+
+#define list_entry(ptr, type, member) \
+        container_of(ptr, type, member)
+
+#define list_first_entry(ptr, type, member) \
+        list_entry((ptr)->next, type, member)
+
+#define list_next_entry(pos, member) \
+        list_entry((pos)->member.next, __typeof__(*(pos)), member)
+
+#define list_for_each_entry(pos, head, member)                          \
+	for (pos = list_first_entry(head, __typeof__(*pos), member);	\
+	     &pos->member != (head);					\
+	     pos = list_next_entry(pos, member))
+
+/* Rate limit definitions */
+struct ratelimit_state {
+        pthread_mutex_t lock;           /* protect the state */
+
+        int             interval;
+        int             burst;
+        int             printed;
+        int             missed;
+        unsigned long   begin;
+};
+
+#define RATELIMIT_STATE_INIT(name, interval_init, burst_init) {         \
+                .lock           = PTHREAD_MUTEX_INITIALIZER,            \
+                .interval       = interval_init,                        \
+                .burst          = burst_init,                           \
+        }
+
+#define RATELIMIT_STATE_INIT_DISABLED                                   \
+        RATELIMIT_STATE_INIT(ratelimit_state, 0, DEFAULT_RATELIMIT_BURST)
+
+#define DEFINE_RATELIMIT_STATE(name, interval_init, burst_init)         \
+                                                                        \
+        struct ratelimit_state name =                                   \
+                RATELIMIT_STATE_INIT(name, interval_init, burst_init)   \
+
+
+#define WARN_ON_RATELIMIT(condition, state)                     \
+        WARN_ON(condition)
+
+/* Notifier definitions */
+#define NOTIFY_DONE             0x0000          /* Don't care */
+#define NOTIFY_OK               0x0001          /* Suits me */
+#define NOTIFY_STOP_MASK        0x8000          /* Don't call further */
+#define NOTIFY_BAD              (NOTIFY_STOP_MASK|0x0002) /* Bad/Veto action */
+
+#ifdef NATIVE
+/* Natively, the arguments are referenced, so that -Wall has no complaint */
+# define atomic_notifier_chain_register(x, y) do { (void)(y); } while (0)
+#else
+# define atomic_notifier_chain_register(x, y) do { } while(0)
+#endif
+
+/* Generic CPU definitions */
+#define CPU_ONLINE              0x0002 /* CPU (unsigned)v is up */
+#define CPU_UP_PREPARE          0x0003 /* CPU (unsigned)v coming up */
+#define CPU_UP_CANCELED         0x0004 /* CPU (unsigned)v NOT coming up */
+#define CPU_DOWN_PREPARE        0x0005 /* CPU (unsigned)v going down */
+#define CPU_DOWN_FAILED         0x0006 /* CPU (unsigned)v NOT going down */
+#define CPU_DEAD                0x0007 /* CPU (unsigned)v dead */
+#define CPU_DYING               0x0008 /* CPU (unsigned)v not running any task,
+                                        * not handling interrupts, soon dead.
+                                        * Called on the dying cpu, interrupts
+                                        * are already disabled. Must not
+                                        * sleep, must not fail */
+#define CPU_POST_DEAD           0x0009 /* CPU (unsigned)v dead, cpu_hotplug
+                                        * lock is dropped */
+#define CPU_STARTING            0x000A /* CPU (unsigned)v soon running.
+                                        * Called on the new cpu, just before
+                                        * enabling interrupts. Must not sleep,
+                                        * must not fail */
+#define CPU_DYING_IDLE          0x000B /* CPU (unsigned)v dying, reached
+                                        * idle loop. */
+
+/* Used for CPU hotplug events occurring while tasks are frozen due to a suspend
+ * operation in progress
+ */
+#define CPU_TASKS_FROZEN        0x0010
+
+#define CPU_ONLINE_FROZEN       (CPU_ONLINE | CPU_TASKS_FROZEN)
+#define CPU_UP_PREPARE_FROZEN   (CPU_UP_PREPARE | CPU_TASKS_FROZEN)
+#define CPU_UP_CANCELED_FROZEN  (CPU_UP_CANCELED | CPU_TASKS_FROZEN)
+#define CPU_DOWN_PREPARE_FROZEN (CPU_DOWN_PREPARE | CPU_TASKS_FROZEN)
+#define CPU_DOWN_FAILED_FROZEN  (CPU_DOWN_FAILED | CPU_TASKS_FROZEN)
+#define CPU_DEAD_FROZEN         (CPU_DEAD | CPU_TASKS_FROZEN)
+#define CPU_DYING_FROZEN        (CPU_DYING | CPU_TASKS_FROZEN)
+#define CPU_STARTING_FROZEN     (CPU_STARTING | CPU_TASKS_FROZEN)
+
+/* Hibernation and suspend events */
+#define PM_HIBERNATION_PREPARE  0x0001 /* Going to hibernate */
+#define PM_POST_HIBERNATION     0x0002 /* Hibernation finished */
+#define PM_SUSPEND_PREPARE      0x0003 /* Going to suspend the system */
+#define PM_POST_SUSPEND         0x0004 /* Suspend finished */
+#define PM_RESTORE_PREPARE      0x0005 /* Going to restore a saved image */
+#define PM_POST_RESTORE         0x0006 /* Restore failed */
+
+
+/* "Cheater" definitions based on restricted Kconfig choices. */
+
+#define CONFIG_TREE_RCU
+#define CONFIG_SMP
+
+#ifndef CONFIG_RCU_FANOUT
+# define CONFIG_RCU_FANOUT 32
+#endif
+
+#ifndef CONFIG_RCU_FANOUT_LEAF
+# define CONFIG_RCU_FANOUT_LEAF 16
+#endif
+
+#define CONFIG_RCU_STALL_COMMON
+#define CONFIG_RCU_CPU_STALL_TIMEOUT 21
+
+/* The pre-v3.19 trees are verified with dynticks-idle, but without nocbs */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0)
+# define CONFIG_NO_HZ
+# undef CONFIG_RCU_NOCB_CPU
+# undef CONFIG_RCU_NOCB_CPU_ALL
+#endif
+
+#ifndef CONFIG_NR_CPUS
+# ifdef FORCE_FAILURE_6
+#  define CONFIG_NR_CPUS (CONFIG_RCU_FANOUT_LEAF + 1)
+# else
+#  define CONFIG_NR_CPUS 2
+# endif
+#endif
+
+#define NR_CPUS CONFIG_NR_CPUS
+#define nr_cpu_ids NR_CPUS
+#ifndef CONFIG_HZ
+# define CONFIG_HZ 100
+#endif
+#define HZ CONFIG_HZ
+
+#undef __CHECKER__
+#undef CONFIG_PREEMPT_RCU
+#undef CONFIG_RCU_FANOUT_EXACT
+#undef CONFIG_RCU_FAST_NO_HZ
+#undef CONFIG_RCU_BOOST
+#undef CONFIG_RCU_CPU_STALL_INFO
+#ifdef NATIVE
+/* Natively, CPUs can be taken offline and back online (fake_hotplug.h) */
+# define CONFIG_HOTPLUG_CPU 1
+#else
+#undef CONFIG_HOTPLUG_CPU
+#endif
+#undef CONFIG_NO_HZ_FULL_SYSIDLE
+#undef CONFIG_RCU_TRACE
+#undef CONFIG_GENERIC_LOCKBREAK
+#undef CONFIG_DEBUG_OBJECTS_RCU_HEAD
+#undef CONFIG_TRACING
+#undef CONFIG_DEBUG_LOCK_ALLOC
+#undef CONFIG_DEBUG_SPINLOCK
+#undef CONFIG_DEBUG_MUTEXES
+#undef CONFIG_RCU_USER_QS
+#undef CONFIG_MODULES
+#undef CONFIG_PROVE_RCU
+#undef CONFIG_TASKS_RCU
+#undef CONFIG_PREEMPT_COUNT
+
+/* Some definitions based on CONFIG_NO_HZ_FULL=n option */
+#define tick_nohz_full_enabled() 0
+#define is_housekeeping_cpu(cpu) 1
+#define housekeeping_affine(cpu) do { } while (0)
+
+#define KTIME_MAX ((s64)~((u64)1 << 63))
+
+/* Stub some compiler directives */
+#ifdef NATIVE
+/*
+ * Natively, alignment annotations take effect, so that the layout of the
+ * RCU data structures (and thus their false sharing) matches the kernel's.
+ * Structures of which per-CPU copies are accessed directly are marked
+ * ____cacheline_aligned_percpu, see DEFINE_PER_CPU().
+ */
+#define SMP_CACHE_BYTES 64
+#define ____cacheline_aligned_in_smp __attribute__((__aligned__(SMP_CACHE_BYTES)))
+#define ____cacheline_internodealigned_in_smp ____cacheline_aligned_in_smp
+#define ____cacheline_aligned_percpu ____cacheline_aligned_in_smp
+#else
+#define ____cacheline_internodealigned_in_smp
+#define ____cacheline_aligned_percpu
+#endif
+#define __percpu
+#define __rcu
+#define __init
+#define __initdata
+#define __cpuinit
+#define __cpuinitdata
+#define __jiffy_data
+#define __read_mostly
+#define __private
+#define __noreturn
+#define __latent_entropy
+
+#define __acquires(x)
+#define __releases(x)
+#define __release(RCU)
+#define __acquire(RCU)
+
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+struct lock_class_key { };
+
+
+/* "Cheater" definitions for percpu variables -- arrays are used instead */
+#ifdef NATIVE
+/*
+ * In the kernel, the copies of a per-CPU variable live in separate per-CPU
+ * areas, so they never share a cache line. Natively, the copies are spread
+ * FAKE_PCPU_STRIDE() elements apart in a cache-line-aligned array, so that
+ * each one starts a cache line of its own. Structures whose size is a
+ * multiple of the cache line size (see ____cacheline_aligned_percpu) are
+ * not spread out, so per-CPU arrays of them can also be indexed directly.
+ *
+ * Before v4.9, rcu_dynticks is smaller than a cache line and statically
+ * initialized for CPUs 0 to NR_CPUS-1, so those trees keep one copy per
+ * element.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 9, 0)
+#define FAKE_PCPU_STRIDE(size)						\
+	(((size) & (SMP_CACHE_BYTES - 1)) ? SMP_CACHE_BYTES / ((size) & -(size)) : 1)
+#else
+#define FAKE_PCPU_STRIDE(size) 1
+#endif
+#define DECLARE_PER_CPU(type, name)					\
+	extern __typeof__(type)						\
+	name[NR_CPUS * FAKE_PCPU_STRIDE(sizeof(type))] ____cacheline_aligned_in_smp
+#define DEFINE_PER_CPU(type, name)					\
+	__typeof__(type)						\
+	name[NR_CPUS * FAKE_PCPU_STRIDE(sizeof(type))] ____cacheline_aligned_in_smp
+#define DEFINE_PER_CPU_SHARED_ALIGNED(type, name) DEFINE_PER_CPU(type, name)
+
+#define per_cpu(var, cpu) ((var)[(cpu) * FAKE_PCPU_STRIDE(sizeof((var)[0]))])
+#define per_cpu_ptr(var, cpu) (&per_cpu(var, cpu))
+
+#define raw_cpu_ptr(var) per_cpu_ptr(var, get_cpu())
+#define raw_cpu_read(var) per_cpu(var, get_cpu())
+#define raw_cpu_write(var, val) per_cpu(var, get_cpu()) = (val)
+#else /* #ifdef NATIVE */
+#define DECLARE_PER_CPU(type, name) extern __typeof__(type) name[NR_CPUS]
+#define DEFINE_PER_CPU(type, name)  __typeof__(type) name[NR_CPUS]
+#define DEFINE_PER_CPU_SHARED_ALIGNED(type, name) DEFINE_PER_CPU(type, name)
+
+#define per_cpu(var, cpu) ((var)[cpu])
+#define per_cpu_ptr(var, cpu) (&(var)[cpu])
+
+#define raw_cpu_ptr(var) per_cpu_ptr(var, get_cpu())
+#define raw_cpu_read(var) per_cpu(var, get_cpu())
+#define raw_cpu_write(var, val) (var)[get_cpu()] = (val)
+#endif /* #ifdef NATIVE */
+
+#define this_cpu_ptr(var) raw_cpu_ptr(var)
+#define __this_cpu_read(var) raw_cpu_read(var)
+#define __this_cpu_write(var, val) raw_cpu_write(var, val)
+
+#ifdef NATIVE
+#define this_cpu_inc(var) per_cpu(var, get_cpu())++
+#else
+#define this_cpu_inc(var) (var)[get_cpu()]++
+#endif
+#define raw_cpu_inc(var) this_cpu_inc(var)
+
+/* Disable CONFIG_RCU_TRACE */
+#define tracepoint_string(x) ""
+#define trace_rcu_utilization(x) do { } while (0)
+#define trace_rcu_grace_period(rcuname, gpnum, gpevent) do { } while (0)
+#define trace_rcu_grace_period_init(rcuname, gpnum, level, grplo, grphi, \
+                                    qsmask) do { } while (0)
+#define trace_rcu_future_grace_period(rcuname, gpnum, completed, c,	\
+                                      level, grplo, grphi, event)	\
+	do { } while (0)
+#define trace_rcu_nocb_wake(rcuname, cpu, reason) do { } while (0)
+#define trace_rcu_preempt_task(rcuname, pid, gpnum) do { } while (0)
+#define trace_rcu_unlock_preempted_task(rcuname, gpnum, pid) do { } while (0)
+#define trace_rcu_quiescent_state_report(rcuname, gpnum, mask, qsmask, level, \
+                                         grplo, grphi, gp_tasks) do { } \
+        while (0)
+#define trace_rcu_fqs(rcuname, gpnum, cpu, qsevent) do { } while (0)
+#define trace_rcu_dyntick(polarity, oldnesting, newnesting) do { } while (0)
+#define trace_rcu_prep_idle(reason) do { } while (0)
+#define trace_rcu_callback(rcuname, rhp, qlen_lazy, qlen) do { } while (0)
+#define trace_rcu_kfree_callback(rcuname, rhp, offset, qlen_lazy, qlen) \
+        do { } while (0)
+#define trace_rcu_batch_start(rcuname, qlen_lazy, qlen, blimit) \
+        do { } while (0)
+#define trace_rcu_invoke_callback(rcuname, rhp) do { } while (0)
+#define trace_rcu_invoke_kfree_callback(rcuname, rhp, offset) do { } while (0)
+#ifdef NATIVE
+/* Natively, the batches of rcu_do_batch() are accounted in fake_softirq.h */
+void fake_batch_end(long count, bool cb, bool nr);
+#define trace_rcu_batch_end(rcuname, callbacks_invoked, cb, nr, iit, risk) \
+	fake_batch_end(callbacks_invoked, cb, nr)
+#else
+#define trace_rcu_batch_end(rcuname, callbacks_invoked, cb, nr, iit, risk) \
+        do { } while (0)
+#endif
+#define trace_rcu_torture_read(rcutorturename, rhp, secs, c_old, c)	\
+        do { } while (0)
+#define trace_rcu_barrier(name, s, cpu, cnt, done) do { } while (0)
+#define trace_rcu_exp_funnel_lock(rcuname, level, grplo, grphi, gpevent) \
+	do { } while (0)
+#define trace_rcu_exp_grace_period(rcuname, gqseq, gpevent) \
+        do { } while (0)
+
+/* Module macros */
+#define MODULE_ALIAS(x)
+#define module_param(name, type, perm)
+#define EXPORT_SYMBOL_GPL(sym)
+#define EXPORT_PER_CPU_SYMBOL_GPL(sym)
+
+/* Logging macros */
+#define pr_info(args...) fprintf(stderr, args)
+#define pr_err(args...) fprintf(stderr, args)
+#define pr_cont(args...) fprintf(stderr, args)
+#define pr_alert(args...) fprintf(stderr, args)
+#define KERN_INFO
+#define KERN_ERR
+#define printk(args...) fprintf(stderr, args)
+
+#define ftrace_dump(x) do { } while (0)
+#define dump_cpu_task(x) do { } while (0)
+#define sched_show_task(x) do { } while (0)
+#define trigger_single_cpu_backtrace(cpu) 1
+#define trigger_all_cpu_backtrace() do { } while (0)
+
+#ifdef NATIVE
+# define lockdep_set_class_and_name(lock, class, name) \
+	do { (void)(class); (void)(name); } while (0)
+#else
+# define lockdep_set_class_and_name(lock, class, name) do { } while (0)
+#endif
+
+#ifdef NATIVE
+/*
+ * Natively, CPU masks are NR_CPUS-bit bitmaps, so that large systems can be
+ * modeled. As in the kernel (with CONFIG_CPUMASK_OFFSTACK=n), cpumask_var_t
+ * is a one-element array, which decays to a pointer when passed around.
+ * Bits are set and cleared atomically. Whole-mask operations go word by
+ * word over a constant number of words, a loop that the compiler unrolls
+ * or vectorizes, and searches use ctz/popcount on whole words.
+ */
+#define CPUMASK_LONGS DIV_ROUND_UP(NR_CPUS, 8 * sizeof(long))
+
+struct cpumask {
+	unsigned long bits[CPUMASK_LONGS];
+};
+typedef struct cpumask cpumask_var_t[1];
+
+cpumask_var_t cpu_possible_mask;
+cpumask_var_t cpu_online_mask;
+
+#define cpumask_word(cpu) ((cpu) / BITS_PER_LONG)
+#define cpumask_bit(cpu) (1UL << ((cpu) % BITS_PER_LONG))
+
+static inline void cpumask_set_cpu(int cpu, struct cpumask *mask)
+{
+	__atomic_fetch_or(&mask->bits[cpumask_word(cpu)], cpumask_bit(cpu),
+			  __ATOMIC_RELAXED);
+}
+
+static inline void cpumask_clear_cpu(int cpu, struct cpumask *mask)
+{
+	__atomic_fetch_and(&mask->bits[cpumask_word(cpu)], ~cpumask_bit(cpu),
+			   __ATOMIC_RELAXED);
+}
+
+static inline bool cpumask_test_cpu(int cpu, const struct cpumask *mask)
+{
+	return __atomic_load_n(&mask->bits[cpumask_word(cpu)],
+			       __ATOMIC_RELAXED) & cpumask_bit(cpu);
+}
+
+static inline void cpumask_clear(struct cpumask *dst)
+{
+	memset(dst, 0, sizeof(*dst));
+}
+
+/* Bits beyond NR_CPUS are never set */
+static inline void cpumask_setall(struct cpumask *dst)
+{
+	int i;
+
+	for (i = 0; i < CPUMASK_LONGS; i++)
+		dst->bits[i] = ~0UL;
+	if (NR_CPUS % BITS_PER_LONG)
+		dst->bits[CPUMASK_LONGS - 1] = cpumask_bit(NR_CPUS) - 1;
+}
+
+static inline void cpumask_copy(struct cpumask *dst, const struct cpumask *src)
+{
+	*dst = *src;
+}
+
+static inline void cpumask_or(struct cpumask *dst, const struct cpumask *src1,
+			      const struct cpumask *src2)
+{
+	int i;
+
+	for (i = 0; i < CPUMASK_LONGS; i++)
+		dst->bits[i] = src1->bits[i] | src2->bits[i];
+}
+
+static inline void cpumask_and(struct cpumask *dst, const struct cpumask *src1,
+			       const struct cpumask *src2)
+{
+	int i;
+
+	for (i = 0; i < CPUMASK_LONGS; i++)
+		dst->bits[i] = src1->bits[i] & src2->bits[i];
+}
+
+static inline bool cpumask_subset(const struct cpumask *src1,
+				  const struct cpumask *src2)
+{
+	unsigned long extra = 0;
+	int i;
+
+	/* No early exit, so that the loop vectorizes */
+	for (i = 0; i < CPUMASK_LONGS; i++)
+		extra |= src1->bits[i] & ~src2->bits[i];
+	return !extra;
+}
+
+static inline int cpumask_weight(const struct cpumask *mask)
+{
+	int i, weight = 0;
+
+	for (i = 0; i < CPUMASK_LONGS; i++)
+		weight += __builtin_popcountl(__atomic_load_n(&mask->bits[i],
+							      __ATOMIC_RELAXED));
+	return weight;
+}
+
+/* Returns nr_cpu_ids if there is no CPU after n in mask */
+static inline int cpumask_next(int n, const struct cpumask *mask)
+{
+	int i = cpumask_word(n + 1);
+	unsigned long word;
+
+	if (n + 1 >= nr_cpu_ids)
+		return nr_cpu_ids;
+	word = __atomic_load_n(&mask->bits[i], __ATOMIC_RELAXED) &
+	       (~0UL << ((n + 1) % BITS_PER_LONG));
+	while (!word) {
+		if (++i >= CPUMASK_LONGS)
+			return nr_cpu_ids;
+		word = __atomic_load_n(&mask->bits[i], __ATOMIC_RELAXED);
+	}
+	return i * BITS_PER_LONG + __builtin_ctzl(word);
+}
+
+#define alloc_bootmem_cpumask_var(x) cpumask_clear(*(x))
+#define zalloc_cpumask_var(cm, GFP) ({ cpumask_clear(*(cm)); true; })
+#define free_cpumask_var(cm) do { } while (0)
+
+#define cpulist_scnprintf(buf, size, mask) do { } while (0)
+#define cpulist_parse(str, mask) do { } while (0)
+#else /* #ifdef NATIVE */
+/* Custom bitwise operations */
+typedef int cpumask_var_t;
+cpumask_var_t cpu_possible_mask;
+cpumask_var_t cpu_online_mask;
+
+#define cpumask_set_cpu(cpu, mask) (mask) |= (1 << (cpu))
+#define cpumask_clear_cpu(cpu, mask) (mask) &= ~(1 << (cpu))
+#define cpumask_copy(dst, src) (dst) = (src)
+
+#define cpumask_or(dst, src1, src2)  (dst) = (src1) | (src2)
+#define cpumask_and(dst, src1, src2) (dst) = (src1) & (src2)
+#define cpumask_subset(src1, src2) (((src1) & ~(src2)) == 0)
+#define cpumask_test_cpu(cpu, cpumask) (((cpumask) & 1 << (cpu)) != 0)
+
+#define alloc_bootmem_cpumask_var(x) do { } while (0)
+#define zalloc_cpumask_var(cm, GFP) true
+#define free_cpumask_var(cm) do { } while (0)
+
+#define cpulist_scnprintf(buf, size, mask) do { } while (0)
+#define cpulist_parse(str, mask) do { } while (0)
+
+int cpumask_weight(cpumask_var_t mask)
+{
+	int set_bits, offset;
+
+	for (set_bits = 0, offset = 1; \
+	     offset <= mask; offset <<= 1)
+		if (offset & mask)
+			set_bits++;
+	return set_bits;
+}
+
+int cpumask_next(int n, cpumask_var_t mask)
+{
+	int cpu, offset;
+
+	for (cpu = n + 1, offset = 1 << (n + 1); \
+	     offset <= mask; cpu++, offset <<= 1) {
+		if (offset & mask)
+			return cpu;
+	}
+	return nr_cpu_ids + 1;
+}
+#endif /* #ifdef NATIVE */
+
+/* Custom macros to set possible and online CPUs */
+#define set_online_cpus() for (int i = 0; i < NR_CPUS; i++) \
+		cpumask_set_cpu(i, cpu_possible_mask);
+#define set_possible_cpus() for (int i = 0; i < NR_CPUS; i++) \
+		cpumask_set_cpu(i, cpu_online_mask);
+
+/* Stub some rcu_expedited stuff */
+int rcu_expedited;
+
+#ifndef NATIVE
+#define try_stop_cpus(exp, fun, arg) 0
+#endif
+#define EAGAIN 0
+#define udelay(time) do { } while (0)
+
+#ifndef NATIVE
+#define stop_one_cpu_nowait(cpu, exp, rdp, sw) do { } while (0)
+#endif
+
+struct cpu_stop_done {
+        atomic_t                nr_todo;        /* nr left to execute */
+        bool                    executed;       /* actually executed? */
+        int                     ret;            /* collected return value */
+	//struct completion       completion;     /* fired if nr_todo reaches 0 */
+};
+
+typedef int (*cpu_stop_fn_t)(void *arg);
+
+struct cpu_stop_work {
+        struct list_head        list;           /* cpu_stopper->works */
+        cpu_stop_fn_t           fn;
+        void                    *arg;
+        struct cpu_stop_done    *done;
+};
+
+#ifdef NATIVE
+/* Natively, CPU stoppers are run through the IPI queues of fake_sched.h */
+int try_stop_cpus(cpumask_var_t cpumask, cpu_stop_fn_t fn, void *arg);
+bool stop_one_cpu_nowait(unsigned int cpu, cpu_stop_fn_t fn, void *arg,
+			 struct cpu_stop_work *work_buf);
+#endif
+
+/* Do not keep track of the process' state */
+#define set_current_state(STATE)
+#define __set_current_state(STATE)
+
+/* Nidhugg will take care of the scheduling for us */
+#define schedule()
+#ifdef NATIVE
+/* Natively, timeouts are backed by the timer wheel of fake_timer.h */
+# define schedule_timeout_interruptible(t) fake_schedule_timeout(t)
+# define schedule_timeout_uninterruptible(t) fake_schedule_timeout(t)
+#else
+/* No timeouts */
+#define schedule_timeout_interruptible(t) do { } while (0)
+#define schedule_timeout_uninterruptible(t) do { } while (0)
+#endif
+
+#ifdef NATIVE
+/*
+ * Natively, each CPU has an idle task with pid 0, which is current while
+ * the CPU enters or leaves idle (see fake_sched.h). A thread that has not
+ * acquired a CPU yet, such as main() bringing the CPUs up, has no task and
+ * counts as the idle task of the CPU it sets.
+ * signal_pending(x) always returns false.
+ */
+#define is_idle_task(p) (!(p) || !(p)->pid)
+#define idle_task(x) (&fake_idle_tasks[x])
+#else
+/* is_idle_task should NOT be a statically defined macro.
+ * However, due to the fact that we are verifying only a portion of Tree RCU's
+ * source code, we CAN set it equal to 1. That way, no warning is triggered
+ * and there should not be any behavioural change for RCU.
+ * idle_task just returns a null pointer.
+ * signal_pending(x) always returns false.
+ */
+#define is_idle_task(current) 1
+#define idle_task(x) NULL
+#endif
+#define signal_pending(x) 0
+
+/* Our definition for task_struct */
+struct task_struct {
+	int pid;
+	pthread_t tid;
+	unsigned long state;
+	char comm[20];
+};
+struct task_struct __thread *current;
+#ifdef NATIVE
+struct task_struct fake_idle_tasks[NR_CPUS] = {
+	[0 ... NR_CPUS - 1] = { .comm = "swapper" }
+};
+#endif
+
+/* CPU iterators based on CONFIG_HOTPLUG_CPU=n */
+#define smp_processor_id() get_cpu()
+#define raw_smp_processor_id() smp_processor_id()
+#if defined(NATIVE) || LINUX_VERSION_CODE >= KERNEL_VERSION(3, 19, 0)
+#define for_each_cpu(cpu, mask)						\
+	for ((cpu) = -1;						\
+	     (cpu) = cpumask_next((cpu), (mask)),			\
+	     (cpu) < nr_cpu_ids;)
+#define for_each_possible_cpu(cpu) for_each_cpu((cpu), cpu_possible_mask)
+#define for_each_online_cpu(cpu) for_each_cpu(cpu, cpu_online_mask)
+#else
+/* The pre-v3.19 tests do not set up the CPU masks */
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < NR_CPUS; (cpu)++)
+#define for_each_online_cpu(cpu) for_each_possible_cpu(cpu)
+#define for_each_cpu(cpu, cm) for_each_possible_cpu(cpu)
+#endif
+
+/*
+ * on_each_cpu() is stubbed because we don't really care about it. This
+ * function is only used in rcu_barrier(), and for the purposes of the
+ * test we can stub it.
+ */
+#define on_each_cpu(func, info, wait) do { } while (0)
+
+/* Softirq definitions and data types */
+#ifdef NATIVE
+/* Natively, softirqs are run by the engine of fake_softirq.h */
+enum {
+	HI_SOFTIRQ = 0,
+	TIMER_SOFTIRQ,
+	NET_TX_SOFTIRQ,
+	NET_RX_SOFTIRQ,
+	BLOCK_SOFTIRQ,
+	IRQ_POLL_SOFTIRQ,
+	TASKLET_SOFTIRQ,
+	SCHED_SOFTIRQ,
+	HRTIMER_SOFTIRQ,
+	RCU_SOFTIRQ,
+	NR_SOFTIRQS
+};
+
+struct softirq_action {
+	void (*action)(struct softirq_action *);
+};
+
+void open_softirq(int nr, void (*action)(struct softirq_action *));
+void raise_softirq(unsigned int nr);
+int fake_in_softirq(void);
+#define in_softirq() fake_in_softirq()
+
+unsigned int fake_kstat_softirqs[NR_CPUS][NR_SOFTIRQS];
+#define kstat_softirqs_cpu(irq, cpu) READ_ONCE(fake_kstat_softirqs[cpu][irq])
+#else /* #ifdef NATIVE */
+#define open_softirq(x, y) do { } while (0)
+int need_softirq[nr_cpu_ids];
+#define raise_softirq(x) do { need_softirq[get_cpu()] = 1; } while (0)
+#define in_softirq() 0
+
+struct softirq_action {
+};
+
+#define kstat_softirqs_cpu(irq, cpu) 0
+#endif /* #ifdef NATIVE */
+
+/* Workqueue definitions and data types */
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+#ifdef NATIVE
+/* Natively, work items are run by the worker pools of fake_workqueue.h */
+#else
+struct work_struct { };
+
+#define INIT_WORK_ONSTACK(_work, _func) do { } while (0)
+
+#define schedule_work(_work) do { } while (0)
+#endif
+
+
+/* Notifier data types -- not of much interest */
+struct notifier_block;
+
+typedef int (*notifier_fn_t)(struct notifier_block *nb,
+			     unsigned long action, void *data);
+
+struct notifier_block {
+	notifier_fn_t notifier_call;
+	struct notifier_block __rcu *next;
+	int priority;
+};
+
+/* Warning statements which trigger assertions */
+int noassert;
+#define SET_NOASSERT() do { noassert = 1; smp_mb(); } while (0)
+#define CK_NOASSERT() ({ smp_mb(); noassert; })
+#define BUG_ON(condition) assert(!(condition) || CK_NOASSERT())
+#define BUILD_BUG_ON(condition) assert(!(condition) || CK_NOASSERT())
+#define WARN_ON(condition) assert(!(condition) || CK_NOASSERT())
+#define WARN_ONCE(condition, format...) assert(!(condition) || CK_NOASSERT())
+#define WARN_ON_ONCE(condition) ({		\
+	int __ret_warn_on = !!(condition);	\
+	assert(!(condition) || CK_NOASSERT());	\
+	__ret_warn_on;				\
+})
+
+#define panic(msg) { perror(msg); assert(0); }
+#define IS_ERR(x) 0
+
+/*
+ * Atomic operations based on cheater definitions and gcc language extensions.
+ * These language extensions are also supported by the clang compiler.
+ * Note that these operations are supported under SC, TSO and PSO in Nidhugg,
+ * but only for the model __ATOMIC_SEQ_CST, even if otherwise specified.
+ */
+#ifdef NATIVE
+/*
+ * Natively, the atomic operations are ordered as in the kernel (see
+ * Documentation/atomic_ops.txt): the ones that return nothing are
+ * unordered, unless bracketed by smp_mb__before_atomic() and
+ * smp_mb__after_atomic(), while the ones that return a value are fully
+ * ordered, as if they had an smp_mb() on either side. On x86, where every
+ * read-modify-write operation is a locked instruction and thus a full
+ * barrier, the kernel only makes the latter a compiler barrier as well,
+ * and so does __fake_atomic_full(); the POWERPC and PSO configs get real
+ * fences from smp_mb__before_atomic() and smp_mb__after_atomic(). Like the
+ * kernel's, atomic_cmpxchg() and cmpxchg() return the old value.
+ *
+ * In simulation mode, read-modify-write operations and full barriers are
+ * charged virtual time for the cache-line transfers they cause (see
+ * fake_sim.h), which also makes them PCT preemption points; -DPCT implies
+ * simulation mode, but fake_native.h only defines SIMULATE for it below.
+ * With -DATOMIC_STATS, each call site of an atomic operation also counts
+ * its calls and the cycles they took (see fake_native.h).
+ */
+# if defined(SIMULATE) || defined(PCT)
+#  define __fake_atomic_rmw(p) fake_sim_rmw(p)
+#  undef smp_mb
+#  define smp_mb() do { fake_sim_mb(); mb(); } while (0)
+# else
+#  define __fake_atomic_rmw(p) do { } while (0)
+# endif
+
+# define __fake_atomic_void(p, op)					\
+({									\
+	__fake_atomic_site(0);						\
+	__fake_atomic_rmw(p);						\
+	(void) (op);							\
+	__fake_atomic_count();						\
+})
+# define __fake_atomic_full(p, op)					\
+({									\
+	__fake_atomic_site(1);						\
+	__typeof__(op) ___ret;						\
+									\
+	__fake_atomic_rmw(p);						\
+	smp_mb__before_atomic();					\
+	___ret = (op);							\
+	smp_mb__after_atomic();						\
+	__fake_atomic_count();						\
+	___ret;								\
+})
+
+# define atomic_add(i, v)						\
+	__fake_atomic_void(&(v)->counter,				\
+			   __atomic_add_fetch(&(v)->counter, i,		\
+					      __ATOMIC_RELAXED))
+# define atomic_add_return(i, v)					\
+	__fake_atomic_full(&(v)->counter,				\
+			   __atomic_add_fetch(&(v)->counter, i,		\
+					      __ATOMIC_SEQ_CST))
+# define atomic_sub(i, v)						\
+	__fake_atomic_void(&(v)->counter,				\
+			   __atomic_sub_fetch(&(v)->counter, i,		\
+					      __ATOMIC_RELAXED))
+# define atomic_sub_return(i, v)					\
+	__fake_atomic_full(&(v)->counter,				\
+			   __atomic_sub_fetch(&(v)->counter, i,		\
+					      __ATOMIC_SEQ_CST))
+# define atomic_inc(v) atomic_add(1, v)
+# define atomic_inc_return(v) atomic_add_return(1, v)
+# define atomic_dec(v) atomic_sub(1, v)
+# define atomic_dec_and_test(v) (atomic_sub_return(1, v) == 0)
+# define atomic_set(v, i) (v)->counter = i
+# define atomic_read(v) ACCESS_ONCE((v)->counter)
+# define cmpxchg(ptr, old, new)						\
+({									\
+	__typeof__(*(ptr)) ___old = (old);				\
+									\
+	__fake_atomic_full(ptr,						\
+			   __atomic_compare_exchange_n(ptr, &___old,	\
+						       new, 0,		\
+						       __ATOMIC_SEQ_CST, \
+						       __ATOMIC_SEQ_CST)); \
+	___old;								\
+})
+# define atomic_cmpxchg(v, old, new) cmpxchg(&(v)->counter, old, new)
+# define xchg(ptr, val)							\
+	__fake_atomic_full(ptr, __atomic_exchange_n(ptr, val,		\
+						    __ATOMIC_SEQ_CST))
+# define atomic_xchg(ptr, val) (xchg(&(ptr)->counter, (val)))
+#else /* #ifdef NATIVE */
+#define atomic_add(i, v) __atomic_add_fetch(&(v)->counter, i, __ATOMIC_RELAXED)
+#define atomic_add_return(i, v) atomic_add(i, v)
+#define atomic_sub(i, v) __atomic_sub_fetch(&(v)->counter, i, __ATOMIC_RELAXED)
+#define atomic_inc(v) atomic_add(1, v)
+#define atomic_inc_return(v) atomic_inc(v)
+#define atomic_dec(v) atomic_sub(1, v)
+#define atomic_dec_and_test(v) !atomic_dec(v)
+#define atomic_set(v, i) (v)->counter = i
+#define atomic_read(v) ACCESS_ONCE((v)->counter)
+#define atomic_cmpxchg(v, old, new)					\
+	__atomic_compare_exchange(&(v)->counter, &old, &new, 0,		\
+				  __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define xchg(ptr, val) __atomic_exchange_n(ptr, val, __ATOMIC_RELAXED)
+#define atomic_xchg(ptr, val) (xchg(&(ptr)->counter, (val)))
+#endif /* #ifdef NATIVE */
+
+#define atomic_long_add(i, v) atomic_add(i, v)
+#define atomic_long_add_return(i, v) atomic_add_return(i, v)
+#define atomic_long_sub(i, v) atomic_sub(i, v)
+#define atomic_long_inc(v) atomic_inc(v)
+#define atomic_long_inc_return(v) atomic_inc_return(v)
+#define atomic_long_dec(v) atomic_dec(v)
+#define atomic_long_dec_and_test(v) atomic_dec_and_test(v)
+#define atomic_long_read(v) atomic_read(v)
+#define atomic_long_cmpxchg(v, old, new) atomic_cmpxchg(v, old, new)
+#define atomic_long_xchg(ptr, val) atomic_xchg(ptr, val)
+
+/* Preempt and bh definitions */
+#define preempt_enable() barrier()
+#define preempt_disable() barrier()
+#define preempt_disable_notrace() barrier()
+#define preempt_enable_notrace() barrier()
+#define local_bh_disable() do { } while (0)
+#define local_bh_enable() do { } while (0)
+#define preemptible() 0
+
+#define prefetch(next) do { } while (0)
+
+/* Time-related definitions */
+#if !defined(NATIVE) && LINUX_VERSION_CODE < KERNEL_VERSION(3, 0, 0)
+/* The v2.6.x tests are verified with jiffies frozen at 0 */
+#define jiffies 0
+#else
+unsigned long volatile __jiffy_data jiffies;
+#endif
+
+#define time_after(a,b)         \
+        (typecheck(unsigned long, a) && \
+         typecheck(unsigned long, b) && \
+         ((long)((b) - (a)) < 0))
+#define time_before(a,b)        time_after(b,a)
+
+#ifdef NATIVE
+/* More CPU-relevant definitions, CONFIG_HOTPLUG_CPU=y */
+#define cpu_online(cpu) cpumask_test_cpu((cpu), cpu_online_mask)
+#define cpu_is_online(cpu) cpu_online(cpu)
+#define cpu_is_offline(cpu) (!cpu_online(cpu))
+bool need_resched(void);
+#define nr_context_switches() 0
+
+/* CPU hotplug operations are excluded by cpu_hotplug_lock */
+pthread_rwlock_t cpu_hotplug_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+#define try_get_online_cpus() (!pthread_rwlock_tryrdlock(&cpu_hotplug_lock))
+#define num_online_cpus() cpumask_weight(cpu_online_mask)
+void fake_get_online_cpus(void);
+#define get_online_cpus() fake_get_online_cpus()
+#define put_online_cpus() pthread_rwlock_unlock(&cpu_hotplug_lock)
+#else /* #ifdef NATIVE */
+/* More CPU-relevant definitions, CONFIG_HOTPLUG_CPU=n  */
+#define cpu_is_offline(cpu) 0
+#define cpu_is_online(cpu) 1
+#define cpu_online(cpu) 1
+#define need_resched() 1
+#define nr_context_switches() 0
+
+/* Exclude CPU hotplug operations */
+#define try_get_online_cpus() 1
+#define num_online_cpus() nr_cpu_ids
+#define get_online_cpus() do {} while (0)
+#define put_online_cpus() do {} while (0)
+#endif /* #ifdef NATIVE */
+#define idle_cpu(cpu) 0
+#define hardirq_count() 0
+#define HARDIRQ_SHIFT 0
+#define cpu_notifier(fn, pri) do { (void)(fn); } while (0)
+#define pm_notifier(fn, pri)  do { (void)(fn); } while (0)
+#define register_cpu_notifier(notifier) do { } while (0)
+#define hotcpu_notifier(n, a) do { } while (0)
+
+typedef void (*smp_call_func_t)(void *info);
+#ifdef NATIVE
+/* Natively, cross-CPU calls are emulated in fake_sched.h */
+#define ENXIO 6
+int smp_call_function_single(int cpu, smp_call_func_t func, void *info,
+			     int wait);
+#else
+#define smp_call_function_single(cpu, fun, arg, wait) 0
+#endif
+
+/* Functions designated to run in initcalls must be called explicitly */
+#ifdef NATIVE
+# define early_initcall(fn) \
+	static int (*__initcall_##fn)(void) __maybe_unused = fn;
+# define core_initcall(fn) \
+	static int (*__initcall_##fn)(void) __maybe_unused = fn;
+#else
+# define early_initcall(fn)
+# define core_initcall(fn)
+#endif
+#define __setup(str, var)
+#define early_param(str,var)
+
+/* Declarations to emulate CPU, interrupts, and scheduling.  */
+void __VERIFIER_assume(int);
+
+int get_cpu(void);
+void set_cpu(int);
+
+int cond_resched(void);
+void smp_send_reschedule(int);
+void set_need_resched(void);
+void fake_acquire_cpu(int);
+void fake_release_cpu(int);
+#define might_sleep() do { } while (0)
+#ifdef NATIVE
+/* As in the kernel, local_irq_save() sets flags, if only to 0 */
+void fake_local_irq_save(void);
+# define local_irq_save(flags) \
+	do { (flags) = 0; fake_local_irq_save(); } while (0)
+#else
+void local_irq_save(unsigned long flags);
+#endif
+void local_irq_restore(unsigned long flags);
+void local_irq_enable(void);
+void local_irq_disable(void);
+int irqs_disabled_flags(unsigned long flags);
+int in_interrupt(void);
+#define in_irq() in_interrupt()
+void do_IRQ(void);
+#ifdef NATIVE
+void fake_run_ipis(void);
+void fake_ipi_check(void);
+#endif
+
+void *run_gp_kthread(void *);
+void *run_nocb_kthread(void *);
+
+#ifdef NATIVE
+/*
+ * Natively, kthreads are entered in the registry of fake_kthread.h, which
+ * runs them on their own; run_gp_kthread() and run_nocb_kthread() are
+ * not used.
+ */
+#define EINVAL 22
+
+struct task_struct *fake_kthread_create(int (*threadfn)(void *data),
+					void *data, const char namefmt[], ...);
+int wake_up_process(struct task_struct *t);
+void kthread_bind(struct task_struct *t, unsigned int cpu);
+int set_cpus_allowed_ptr(struct task_struct *t, cpumask_var_t mask);
+bool kthread_should_stop(void);
+void fake_kthread_wait(unsigned int *uaddr, unsigned int val);
+void fake_kthread_exit(void);
+int fake_kthread_migrate(int cpu);
+void fake_kthread_account(int oncpu);
+
+#define kthread_create(threadfn, data, ...) \
+	fake_kthread_create(threadfn, data, __VA_ARGS__)
+#define kthread_run(threadfn, data, ...)				\
+({									\
+	struct task_struct *__k = kthread_create(threadfn, data, __VA_ARGS__); \
+									\
+	if (!IS_ERR(__k))						\
+		wake_up_process(__k);					\
+	__k;								\
+})
+
+struct smp_hotplug_thread {
+	struct task_struct *(*store)[NR_CPUS];
+	int (*thread_should_run)(unsigned int cpu);
+	void (*thread_fn)(unsigned int cpu);
+	void (*setup)(unsigned int cpu);
+	void (*park)(unsigned int cpu);
+	const char *thread_comm;
+};
+
+int smpboot_register_percpu_thread(struct smp_hotplug_thread *ht);
+#else /* #ifdef NATIVE */
+#define get_macro(_1, _2, _3, _4, _5, name, ...) name
+#define kthread_run(...) \
+	get_macro(__VA_ARGS__, spawn_nocb_kthread, spawn_gp_kthread)(__VA_ARGS__)
+
+struct task_struct *spawn_gp_kthread(int (*threadfn)(void *data), void *data,
+				   const char namefmt[], const char name[])
+{
+	pthread_t t;
+        struct task_struct *task = NULL;
+
+        if (!strcmp(name, "rcu_sched") || IS_ENABLED(ENABLE_RCU_BH)) {
+		if (pthread_create(&t, NULL, run_gp_kthread, data))
+			abort();
+		task = malloc(sizeof(*task));
+		task->pid = (unsigned long) t;
+		task->tid = t;
+		return task;
+	}
+	return NULL;
+}
+
+struct task_struct *spawn_nocb_kthread(int (*threadfn)(void *data), void *data,
+				       const char namefmt[], char abbr, int cpu)
+{
+	pthread_t t;
+        struct task_struct *task = NULL;
+
+        if (abbr == 's' || IS_ENABLED(ENABLE_RCU_BH)) {
+		if (pthread_create(&t, NULL, run_nocb_kthread, data))
+			abort();
+		task = malloc(sizeof(*task));
+		task->pid = (unsigned long) t;
+		task->tid = t;
+		return task;
+	}
+	return NULL;
+}
+
+#define kthread_create(threadfn, data, namefmt, name) kthread_run(threadfn, data, namefmt, name)
+#define wake_up_process(t) do { } while (0)
+#endif /* #ifdef NATIVE */
+
+#define sched_setscheduler_nocheck(task, policy, param) do { } while (0)
+
+int rcu_normal;
+
+/*
+ * In recent kernel versions rcu_cpu_starting() has to be called for all
+ * online CPUs. We need to do this manually.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 9, 0)
+#define MARK_ONLINE_CPUS 1
+#endif
+
+#ifdef NATIVE
+#include "fake_native.h"
+#include "fake_timer.h"
+#include "fake_workqueue.h"
+#endif
+
+#endif /* __FAKE_DEFS_H */
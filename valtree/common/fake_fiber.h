@@ -0,0 +1,1161 @@
+/*
+ * M:N scheduling of the emulated threads for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_FIBER_H
+#define __FAKE_FIBER_H
+
+#include <errno.h>
+#include <sys/mman.h>
+#if !defined(__x86_64__) || defined(FIBER_UCONTEXT)
+# include <ucontext.h>
+#endif
+
+/*
+ * With -DFIBERS, every thread created with pthread_create() (updaters,
+ * kthreads, IRQ threads, the timekeeper...) is a fiber with its own
+ * FIBER_STACK_KB stack, and FIBER_WORKERS host threads (by default, one
+ * per online host CPU) run them. A fiber only gives up its host thread
+ * when it waits: in fake_futex_wait() and friends, on a contended pthread
+ * lock, in sched_yield() (and thus in contended spinlocks) and in
+ * cond_resched(). Thousands of emulated CPUs then cost a few host threads
+ * and a context switch of a few dozen nanoseconds, instead of thousands of
+ * host threads that the host scheduler has to wake up and migrate.
+ *
+ * Each fiber stays on the host thread that first ran it, so that the
+ * addresses of thread-local variables, which the compiler may keep across
+ * a switch, remain valid. The thread-local state of the emulation
+ * (__running_cpu, current, the interrupt nesting...) is saved and restored
+ * at each switch. A fiber's "thread ID", as seen by irq_mask[], is
+ * FIBER_TID_BASE plus its number, so NMIs, which are signals sent to host
+ * threads, cannot be injected into fibers.
+ *
+ * A worker parks a fiber once it is off the fiber's stack, with
+ * fake_fiber_lock held: it registers the fiber in the wait bucket of the
+ * futex word or lock, and only then checks whether the fiber still has to
+ * wait, i.e., whether the word still holds the expected value or whether
+ * the lock is still taken (a free lock is taken on the fiber's behalf).
+ * Wakers, which change the word or release the lock first, only take
+ * fake_fiber_lock if the bucket has waiters; host threads (such as main())
+ * still sleep on real futexes, and are only woken with a system call if
+ * there are any. The main thread is never a fiber.
+ */
+#ifndef FIBER_WORKERS
+# define FIBER_WORKERS 0
+#endif
+#ifndef FIBER_STACK_KB
+# define FIBER_STACK_KB 64
+#endif
+#define FIBER_BUCKET_BITS 10
+#define FIBER_TID_BASE (1 << 29)
+
+enum {
+	FIBER_YIELD,
+	FIBER_FUTEX,		/* Sleep while *addr == val, or until deadline */
+	FIBER_MUTEX,		/* Sleep until the mutex at addr is taken */
+	FIBER_RDLOCK,		/* Same, for an rwlock */
+	FIBER_WRLOCK,
+	FIBER_EXIT,
+};
+
+#if defined(__x86_64__) && !defined(FIBER_UCONTEXT)
+struct fake_fiber_ctx {
+	void *sp;
+};
+#else
+struct fake_fiber_ctx {
+	ucontext_t uc;
+};
+#endif
+
+struct fake_fiber_worker;
+
+struct fake_fiber {
+	struct fake_fiber_ctx ctx;
+	struct fake_fiber_worker *worker;
+	void *(*fn)(void *);
+	void *arg;
+	void *ret;
+	void *stack;		/* Including the guard page */
+	size_t stack_size;
+	unsigned int exited;
+
+	/* What to wait for; the worker parks the fiber once switched out */
+	int op;
+	void *addr;
+	unsigned int val;
+	u64 deadline;		/* Host monotonic clock, 0 for none */
+	bool acquired;		/* The lock was taken on the fiber's behalf */
+	bool waiting;		/* Parked by the worker, not woken up yet */
+
+	struct fake_fiber *next;	/* In a run queue or a wait bucket */
+	struct fake_fiber **pprev;	/* In a wait bucket */
+	int heap_idx;		/* In the worker's heap, or -1 */
+	u64 when;		/* Key in the worker's heap */
+#ifdef SIMULATE
+	u64 vtime;		/* Virtual time of the fiber */
+#endif
+#ifdef PCT
+	u64 prio;		/* See fake_pct.h */
+	bool yielded;		/* Called sched_yield(), not run since */
+#endif
+
+	/* Thread-local state of the fiber, saved while it is switched out */
+	pid_t tid;
+	int cpu;
+	struct task_struct *current;
+	struct task_struct *irq_task;
+	struct fake_kthread *kthread;
+	int hardirq_count;
+	int in_ipi;
+	int serving_softirq;
+	int irq_depth;		/* local_irq_depth[cpu] */
+	struct task_struct task;	/* Its current, unless a kthread's */
+
+	/* Statistics */
+	unsigned long nr_switches;
+	u64 run_ns;		/* Time spent switched in */
+};
+
+struct fake_fiber_worker {
+	pthread_t thread;
+	struct fake_fiber_ctx ctx;
+	struct fake_fiber *runq;
+	struct fake_fiber **runq_tail;
+	struct fake_fiber **heap;	/* Fibers by deadline (see below) */
+	int heap_nr;
+	int heap_size;
+	unsigned int kick;	/* Futex word the worker sleeps on when idle */
+	bool idle;
+
+	/* Statistics */
+	unsigned long nr_fibers;	/* Fibers created */
+	unsigned long nr_switches;
+	unsigned long nr_idle;		/* Times the worker went to sleep */
+} ____cacheline_aligned_in_smp;
+
+struct fake_fiber_bucket {
+	unsigned int nr_waiters;
+	struct fake_fiber *waiters;
+	struct fake_fiber **tail;
+};
+
+/* Protects the run queues, the deadline heaps and the wait buckets */
+static pthread_mutex_t fake_fiber_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t fake_fiber_once = PTHREAD_ONCE_INIT;
+static struct fake_fiber_bucket fake_fiber_buckets[1 << FIBER_BUCKET_BITS];
+static struct fake_fiber_worker *fake_fiber_workers;
+static int fake_fiber_nr_workers;
+static unsigned int fake_fiber_next_id;
+/* Host threads sleeping in fake_futex_wait() and friends */
+static unsigned int fake_fiber_host_waiters;
+static struct fake_fiber __thread *fake_fiber_current;
+static u64 __thread fake_fiber_since;	/* When it was switched in */
+#ifdef SIMULATE
+/* Virtual time of the main thread: the latest time a fiber has reached */
+static u64 fake_sim_now;
+#endif
+#ifdef PCT
+/* Priority of the main thread, and whether it waits rather than runs */
+static u64 fake_pct_host_prio;
+static bool fake_pct_host_waiting;
+/* Until when the virtual time may skip ahead (see fake_fiber_skip_time()) */
+static u64 fake_pct_skip_until;
+/* Thread ids of the recorded schedules, 0 for the main thread */
+# define fake_pct_id(f) ((f) ? (f)->tid & ~FIBER_TID_BASE : 0)
+static bool fake_pct_replay_next(unsigned int *id, u64 *now);
+static void fake_pct_replay_diverged(void);
+static void fake_pct_switch(struct fake_fiber *f);
+#endif
+
+static void fake_fiber_start(void) __attribute__((noreturn));
+
+#if defined(__x86_64__) && !defined(FIBER_UCONTEXT)
+/*
+ * Push the callee-saved registers, save the stack pointer to *from, switch
+ * to the stack at to and pop its registers. A new fiber's stack "returns"
+ * into fake_fiber_start().
+ */
+void fake_fiber_switch_sp(void **from, void *to);
+asm(".text\n"
+    "fake_fiber_switch_sp:\n"
+    "	pushq %rbp\n"
+    "	pushq %rbx\n"
+    "	pushq %r12\n"
+    "	pushq %r13\n"
+    "	pushq %r14\n"
+    "	pushq %r15\n"
+    "	movq %rsp, (%rdi)\n"
+    "	movq %rsi, %rsp\n"
+    "	popq %r15\n"
+    "	popq %r14\n"
+    "	popq %r13\n"
+    "	popq %r12\n"
+    "	popq %rbx\n"
+    "	popq %rbp\n"
+    "	ret\n");
+
+static void fake_fiber_ctx_init(struct fake_fiber_ctx *ctx, void *stack,
+				size_t size)
+{
+	void **sp = (void **) ((char *) stack + size);
+	int i;
+
+	/* As after a call: %rsp + 8 is 16-byte aligned on entry */
+	*--sp = NULL;
+	*--sp = (void *) fake_fiber_start;
+	for (i = 0; i < 6; i++)
+		*--sp = NULL;
+	ctx->sp = sp;
+}
+
+static inline void fake_fiber_ctx_switch(struct fake_fiber_ctx *from,
+					 struct fake_fiber_ctx *to)
+{
+	fake_fiber_switch_sp(&from->sp, to->sp);
+}
+#else
+static void fake_fiber_ctx_init(struct fake_fiber_ctx *ctx, void *stack,
+				size_t size)
+{
+	if (getcontext(&ctx->uc))
+		abort();
+	ctx->uc.uc_stack.ss_sp = stack;
+	ctx->uc.uc_stack.ss_size = size;
+	ctx->uc.uc_link = NULL;
+	makecontext(&ctx->uc, fake_fiber_start, 0);
+}
+
+static inline void fake_fiber_ctx_switch(struct fake_fiber_ctx *from,
+					 struct fake_fiber_ctx *to)
+{
+	if (swapcontext(&from->uc, &to->uc))
+		abort();
+}
+#endif
+
+static inline struct fake_fiber_bucket *fake_fiber_bucket(void *addr)
+{
+	return &fake_fiber_buckets[(u64) (unsigned long) addr *
+				   0x9E3779B97F4A7C15ULL >>
+				   (64 - FIBER_BUCKET_BITS)];
+}
+
+static void fake_fiber_heap_set(struct fake_fiber_worker *w, int i,
+				struct fake_fiber *f)
+{
+	w->heap[i] = f;
+	f->heap_idx = i;
+}
+
+/* Put f in slot i of the heap, and move it up or down */
+static void fake_fiber_heap_fix(struct fake_fiber_worker *w, int i,
+				struct fake_fiber *f)
+{
+	int c;
+
+	while (i > 0 && w->heap[(i - 1) / 2]->when > f->when) {
+		fake_fiber_heap_set(w, i, w->heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= w->heap_nr)
+			break;
+		if (c + 1 < w->heap_nr &&
+		    w->heap[c + 1]->when < w->heap[c]->when)
+			c++;
+		if (w->heap[c]->when >= f->when)
+			break;
+		fake_fiber_heap_set(w, i, w->heap[c]);
+		i = c;
+	}
+	fake_fiber_heap_set(w, i, f);
+}
+
+static void fake_fiber_heap_add(struct fake_fiber_worker *w,
+				struct fake_fiber *f)
+{
+	if (w->heap_nr == w->heap_size) {
+		w->heap_size = w->heap_size ? 2 * w->heap_size : 64;
+		w->heap = realloc(w->heap, w->heap_size * sizeof(*w->heap));
+		if (!w->heap)
+			abort();
+	}
+	fake_fiber_heap_fix(w, w->heap_nr++, f);
+}
+
+static void fake_fiber_heap_del(struct fake_fiber_worker *w,
+				struct fake_fiber *f)
+{
+	struct fake_fiber *last = w->heap[--w->heap_nr];
+
+	if (last != f)
+		fake_fiber_heap_fix(w, f->heap_idx, last);
+	f->heap_idx = -1;
+}
+
+#ifdef PCT
+/*
+ * With -DPCT, the run queue holds the runnable fibers by decreasing
+ * priority, followed by the ones that yielded, in the order they did: a
+ * fiber that yields lets every other runnable fiber go first. The heap
+ * only holds the sleeping fibers, by deadline.
+ */
+static void fake_fiber_ready(struct fake_fiber *f)
+{
+	struct fake_fiber_worker *w = f->worker;
+	struct fake_fiber **pp = &w->runq;
+
+	if (f->yielded)
+		pp = w->runq_tail;
+	else
+		while (*pp && !(*pp)->yielded && (*pp)->prio > f->prio)
+			pp = &(*pp)->next;
+	f->next = *pp;
+	*pp = f;
+	if (!f->next)
+		w->runq_tail = &f->next;
+}
+#elif defined(SIMULATE) /* #ifdef PCT */
+/*
+ * In simulation mode, a single host thread runs the fibers, in the order
+ * of their virtual times (see fake_fiber_step()): the heap is the event
+ * queue, and holds both the runnable fibers, by virtual time, and the
+ * sleeping ones, by deadline.
+ */
+static void fake_fiber_ready(struct fake_fiber *f)
+{
+	f->when = f->vtime;
+	fake_fiber_heap_add(f->worker, f);
+}
+#else /* #ifdef PCT */
+/* Queue f on its worker, waking the worker up if need be */
+static void fake_fiber_ready(struct fake_fiber *f)
+{
+	struct fake_fiber_worker *w = f->worker;
+
+	f->next = NULL;
+	*w->runq_tail = f;
+	w->runq_tail = &f->next;
+	if (w->idle) {
+		w->idle = false;
+		w->kick++;
+		fake_host_futex_wake(&w->kick, 1);
+	}
+}
+#endif /* #ifdef PCT */
+
+/* Take f out of its wait bucket and the heap, and queue it */
+static void fake_fiber_unwait(struct fake_fiber *f)
+{
+	struct fake_fiber_bucket *b;
+
+	f->waiting = false;
+	if (f->addr) {
+		b = fake_fiber_bucket(f->addr);
+		*f->pprev = f->next;
+		if (f->next)
+			f->next->pprev = f->pprev;
+		else
+			b->tail = f->pprev;
+		__atomic_fetch_sub(&b->nr_waiters, 1, __ATOMIC_RELAXED);
+	}
+	if (f->heap_idx >= 0)
+		fake_fiber_heap_del(f->worker, f);
+	fake_fiber_ready(f);
+}
+
+/* Wake at most nr fibers waiting on addr; returns how many were woken */
+static int fake_fiber_wake_locked(void *addr, int nr)
+{
+	struct fake_fiber *f, *next;
+	int woken = 0;
+#ifdef SIMULATE
+	u64 now = fake_clock_ns();
+#endif
+
+	for (f = fake_fiber_bucket(addr)->waiters; f && woken < nr; f = next) {
+		next = f->next;
+		if (f->addr != addr)
+			continue;
+#ifdef SIMULATE
+		/* A fiber wakes up no earlier than its waker's time */
+		if (f->vtime < now)
+			f->vtime = now;
+#endif
+		fake_fiber_unwait(f);
+		woken++;
+	}
+	return woken;
+}
+
+/*
+ * Wake at most nr fibers waiting on addr, which the caller has just
+ * changed (or unlocked); does not touch the memory at addr.
+ */
+static int fake_fiber_wake(void *addr, int nr)
+{
+	int woken;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&fake_fiber_bucket(addr)->nr_waiters,
+			     __ATOMIC_RELAXED))
+		return 0;
+	(pthread_mutex_lock)(&fake_fiber_lock);
+	woken = fake_fiber_wake_locked(addr, nr);
+	(pthread_mutex_unlock)(&fake_fiber_lock);
+	return woken;
+}
+
+/* Take the lock at l as op says, without blocking */
+static bool fake_fiber_trylock(void *l, int op)
+{
+	switch (op) {
+	case FIBER_MUTEX:
+		return !(pthread_mutex_trylock)(l);
+	case FIBER_RDLOCK:
+		return !(pthread_rwlock_tryrdlock)(l);
+	case FIBER_WRLOCK:
+		return !(pthread_rwlock_trywrlock)(l);
+	}
+	abort();
+}
+
+/* Whether a fiber that is being parked still has to wait */
+static bool fake_fiber_must_wait(struct fake_fiber *f)
+{
+	if (f->op == FIBER_FUTEX)
+		return __atomic_load_n((unsigned int *) f->addr,
+				       __ATOMIC_RELAXED) == f->val;
+	f->acquired = fake_fiber_trylock(f->addr, f->op);
+	return !f->acquired;
+}
+
+/* Called by the worker of a fiber that has exited, off its stack */
+static void fake_fiber_retire(struct fake_fiber *f)
+{
+	unsigned int *exited = &f->exited;
+
+	if (munmap(f->stack, f->stack_size))
+		abort();
+	/* The fiber may be freed by its joiner from here on */
+	__atomic_store_n(exited, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&fake_fiber_bucket(exited)->nr_waiters,
+			    __ATOMIC_RELAXED))
+		fake_fiber_wake_locked(exited, INT_MAX);
+	if (__atomic_load_n(&fake_fiber_host_waiters, __ATOMIC_SEQ_CST))
+		fake_host_futex_wake(exited, INT_MAX);
+}
+
+/* Carry out what f asked for when it switched out */
+static void fake_fiber_complete(struct fake_fiber_worker *w,
+				struct fake_fiber *f)
+{
+	struct fake_fiber_bucket *b;
+
+	switch (f->op) {
+	case FIBER_YIELD:
+		fake_fiber_ready(f);
+		return;
+	case FIBER_EXIT:
+		fake_fiber_retire(f);
+		return;
+	}
+	f->waiting = true;
+	if (f->addr) {
+		b = fake_fiber_bucket(f->addr);
+		__atomic_fetch_add(&b->nr_waiters, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (!fake_fiber_must_wait(f)) {
+			__atomic_fetch_sub(&b->nr_waiters, 1,
+					   __ATOMIC_RELAXED);
+			f->waiting = false;
+			fake_fiber_ready(f);
+			return;
+		}
+		f->next = NULL;
+		f->pprev = b->tail;
+		*b->tail = f;
+		b->tail = &f->next;
+	}
+	if (f->deadline) {
+		f->when = f->deadline;
+		fake_fiber_heap_add(w, f);
+	}
+}
+
+/*
+ * Switch to f until it switches back, and carry out what it asked for.
+ * Called, and returns, with fake_fiber_lock held.
+ */
+static void fake_fiber_run(struct fake_fiber_worker *w, struct fake_fiber *f)
+{
+	(pthread_mutex_unlock)(&fake_fiber_lock);
+	fake_fiber_current = f;
+	fake_fiber_since = fake_host_clock_ns();
+	fake_fiber_ctx_switch(&w->ctx, &f->ctx);
+	f->run_ns += fake_host_clock_ns() - fake_fiber_since;
+	f->nr_switches++;
+	w->nr_switches++;
+	fake_fiber_current = NULL;
+#ifdef SIMULATE
+	if (fake_sim_now < f->vtime)
+		fake_sim_now = f->vtime;
+#endif
+	(pthread_mutex_lock)(&fake_fiber_lock);
+	fake_fiber_complete(w, f);
+}
+
+#ifndef SIMULATE
+static void *fake_fiber_worker_fn(void *arg)
+{
+	struct fake_fiber_worker *w = arg;
+	struct fake_fiber *f;
+	unsigned int kick;
+	u64 now, deadline;
+
+#ifdef PIN_CPUS
+	fake_pin_worker(w - fake_fiber_workers);
+#endif
+	(pthread_mutex_lock)(&fake_fiber_lock);
+	for (;;) {
+		if (w->heap_nr) {
+			now = fake_host_clock_ns();
+			while (w->heap_nr && w->heap[0]->when <= now)
+				fake_fiber_unwait(w->heap[0]);
+		}
+		f = w->runq;
+		if (!f) {
+			deadline = w->heap_nr ? w->heap[0]->when : 0;
+			kick = w->kick;
+			w->idle = true;
+			w->nr_idle++;
+			(pthread_mutex_unlock)(&fake_fiber_lock);
+			if (deadline)
+				fake_host_futex_wait_until(&w->kick, kick,
+							   deadline);
+			else
+				fake_host_futex_wait(&w->kick, kick);
+			(pthread_mutex_lock)(&fake_fiber_lock);
+			w->idle = false;
+			continue;
+		}
+		w->runq = f->next;
+		if (!w->runq)
+			w->runq_tail = &w->runq;
+		fake_fiber_run(w, f);
+	}
+	return NULL;
+}
+#endif /* #ifndef SIMULATE */
+
+static void fake_fiber_init(void)
+{
+	struct fake_fiber_worker *w;
+	int i, nr = FIBER_WORKERS;
+
+	if (nr <= 0)
+		nr = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr <= 0 || IS_ENABLED(SIMULATE))
+		nr = 1;
+	for (i = 0; i < ARRAY_SIZE(fake_fiber_buckets); i++)
+		fake_fiber_buckets[i].tail = &fake_fiber_buckets[i].waiters;
+	if (posix_memalign((void **) &fake_fiber_workers, SMP_CACHE_BYTES,
+			   nr * sizeof(*fake_fiber_workers)))
+		abort();
+	memset(fake_fiber_workers, 0, nr * sizeof(*fake_fiber_workers));
+	fake_fiber_nr_workers = nr;
+	for (i = 0; i < nr; i++) {
+		w = &fake_fiber_workers[i];
+		w->runq_tail = &w->runq;
+#ifndef SIMULATE
+		if ((pthread_create)(&w->thread, NULL, fake_fiber_worker_fn, w))
+			abort();
+#endif
+	}
+}
+
+/*
+ * Only the entry of local_irq_depth[] of the fiber's CPU is saved: the
+ * emulation never changes CPUs with interrupts disabled.
+ */
+static inline void fake_fiber_save(struct fake_fiber *f)
+{
+	f->cpu = __running_cpu;
+	f->current = current;
+	f->irq_task = fake_irq_task;
+	f->kthread = fake_kthread_self;
+	f->hardirq_count = fake_hardirq_count;
+	f->in_ipi = fake_in_ipi;
+	f->serving_softirq = fake_serving_softirq;
+	f->irq_depth = local_irq_depth[f->cpu];
+	local_irq_depth[f->cpu] = 0;
+}
+
+static inline void fake_fiber_restore(struct fake_fiber *f)
+{
+	__running_cpu = f->cpu;
+	current = f->current;
+	fake_irq_task = f->irq_task;
+	fake_kthread_self = f->kthread;
+	fake_tid = f->tid;
+	fake_hardirq_count = f->hardirq_count;
+	fake_in_ipi = f->in_ipi;
+	fake_serving_softirq = f->serving_softirq;
+	local_irq_depth[f->cpu] = f->irq_depth;
+}
+
+/* Switch to the worker, which does what op says */
+static void fake_fiber_park(struct fake_fiber *f, int op)
+{
+	f->op = op;
+	fake_fiber_save(f);
+	fake_fiber_ctx_switch(&f->ctx, &f->worker->ctx);
+	fake_fiber_restore(f);
+}
+
+static void fake_fiber_start(void)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	fake_fiber_restore(f);
+	fake_fiber_exit(f->fn(f->arg));
+}
+
+#ifdef PCT
+/* The main thread waits for the fibers, or runs again */
+static void fake_pct_host_wait(bool waiting)
+{
+	fake_pct_host_waiting = waiting;
+	if (!waiting)
+		fake_pct_switch(NULL);
+}
+#else
+# define fake_pct_host_wait(waiting) do { } while (0)
+#endif
+
+#ifdef SIMULATE
+/*
+ * In simulation mode, there are no worker threads: the main thread runs
+ * the fibers, one event at a time, whenever it waits, so that runs are
+ * deterministic. The virtual time of a fiber only advances when it is
+ * charged for an operation (see fake_sim.h), when it sleeps until a
+ * deadline, when it is woken up by a fiber that is ahead of it, and when
+ * it yields: then it spins, in virtual time, until the next event.
+ * Virtual time between events is skipped.
+ */
+#ifndef SIM_YIELD_NS
+# define SIM_YIELD_NS 50
+#endif
+/* How far a fiber may get ahead of the next event before it yields */
+#ifndef SIM_QUANTUM_NS
+# define SIM_QUANTUM_NS 1000
+#endif
+
+#ifdef PCT
+/*
+ * With -DPCT, the fibers do not run in the order of their virtual times,
+ * so they share a single clock, which is only used for their deadlines.
+ */
+u64 fake_clock_ns(void)
+{
+	return fake_sim_now;
+}
+
+void fake_fiber_advance(u64 ns)
+{
+	fake_sim_now += ns;
+}
+
+/* Wake up the fibers whose deadline has come, with fake_fiber_lock held */
+static void fake_fiber_wake_due(struct fake_fiber_worker *w)
+{
+	while (w->heap_nr && w->heap[0]->when <= fake_sim_now)
+		fake_fiber_unwait(w->heap[0]);
+}
+
+/*
+ * If prio, and the priority of every runnable fiber that has not yielded,
+ * were given at change points, let the virtual time skip to the next
+ * deadline: the threads that could run are then taken to be preempted,
+ * for up to PCT_DELAY_JIFFIES after the last change point (see fake_pct.h).
+ */
+static void fake_fiber_skip_time(struct fake_fiber_worker *w, u64 prio)
+{
+	if (w->runq && !w->runq->yielded && w->runq->prio > prio)
+		prio = w->runq->prio;
+	if (prio < PCT_DEPTH && w->heap_nr &&
+	    w->heap[0]->when <= fake_pct_skip_until) {
+		fake_sim_now = w->heap[0]->when;
+		fake_fiber_wake_due(w);
+	}
+}
+
+/*
+ * Take the fiber to run next out of the run queue: the one that the trace
+ * being replayed runs next, once the virtual time has got to when it did,
+ * or else the runnable fiber with the highest priority. If there is none,
+ * or if all of them are spinning, i.e., have yielded, first let the
+ * virtual time skip to the next deadline, if it is due by limit: the
+ * spinning fibers then compete by priority again, with the ones that were
+ * woken up. Returns NULL if no fiber is to run.
+ */
+static struct fake_fiber *fake_fiber_pick(struct fake_fiber_worker *w,
+					  u64 limit)
+{
+	struct fake_fiber *f, *next, **pp;
+	unsigned int id;
+	u64 now;
+
+	if (fake_pct_replay_next(&id, &now)) {
+		if (!id || now > limit)
+			return NULL;
+		if (fake_sim_now < now) {
+			fake_sim_now = now;
+			fake_fiber_wake_due(w);
+		}
+		for (pp = &w->runq; (f = *pp); pp = &f->next) {
+			if (fake_pct_id(f) != id)
+				continue;
+			*pp = f->next;
+			if (!f->next)
+				w->runq_tail = pp;
+			return f;
+		}
+		fake_pct_replay_diverged();
+	}
+	fake_fiber_skip_time(w, fake_pct_host_waiting ? 0 : fake_pct_host_prio);
+	if ((!w->runq || w->runq->yielded) && w->heap_nr &&
+	    w->heap[0]->when <= limit) {
+		fake_sim_now = w->heap[0]->when;
+		f = w->runq;
+		w->runq = NULL;
+		w->runq_tail = &w->runq;
+		for (; f; f = next) {
+			next = f->next;
+			f->yielded = false;
+			fake_fiber_ready(f);
+		}
+		fake_fiber_wake_due(w);
+	}
+	f = w->runq;
+	if (f) {
+		w->runq = f->next;
+		if (!w->runq)
+			w->runq_tail = &w->runq;
+	}
+	return f;
+}
+
+/*
+ * Run the fiber that fake_fiber_pick() takes. Returns false if there was
+ * no fiber to run.
+ */
+static bool fake_fiber_step(u64 limit)
+{
+	struct fake_fiber_worker *w;
+	struct fake_fiber *f, host;
+	bool ran = false;
+
+	pthread_once(&fake_fiber_once, fake_fiber_init);
+	w = &fake_fiber_workers[0];
+	fake_fiber_save(&host);
+	host.tid = fake_tid;
+	(pthread_mutex_lock)(&fake_fiber_lock);
+	fake_fiber_wake_due(w);
+	f = fake_fiber_pick(w, limit);
+	if (f) {
+		f->yielded = false;
+		fake_pct_switch(f);
+		fake_fiber_run(w, f);
+		ran = true;
+	}
+	(pthread_mutex_unlock)(&fake_fiber_lock);
+	fake_fiber_restore(&host);
+	return ran;
+}
+
+/*
+ * Whether a thread of priority prio has to give way: to another thread,
+ * if the trace being replayed runs it next, or else to a runnable fiber of
+ * higher priority that has not yielded, or, for a fiber, to the main
+ * thread if it has a higher priority and is not waiting.
+ */
+static bool fake_fiber_preempted(u64 prio)
+{
+	struct fake_fiber_worker *w = &fake_fiber_workers[0];
+	unsigned int id;
+	u64 now;
+	bool ret;
+
+	(pthread_mutex_lock)(&fake_fiber_lock);
+	fake_fiber_wake_due(w);
+	if (fake_pct_replay_next(&id, &now)) {
+		ret = id != fake_pct_id(fake_fiber_current);
+		if (!ret && fake_sim_now < now) {
+			fake_sim_now = now;
+			fake_fiber_wake_due(w);
+		}
+	} else {
+		ret = fake_fiber_current && !fake_pct_host_waiting &&
+		      fake_pct_host_prio > prio;
+		fake_fiber_skip_time(w, ret ? fake_pct_host_prio : prio);
+		ret |= w->runq && !w->runq->yielded && w->runq->prio > prio;
+	}
+	(pthread_mutex_unlock)(&fake_fiber_lock);
+	return ret;
+}
+#else /* #ifdef PCT */
+u64 fake_clock_ns(void)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	return f ? f->vtime : fake_sim_now;
+}
+
+/* Charge ns of virtual time to the current fiber, or the main thread */
+void fake_fiber_advance(u64 ns)
+{
+	struct fake_fiber *f = fake_fiber_current;
+	struct fake_fiber_worker *w;
+
+	if (!f) {
+		fake_sim_now += ns;
+		return;
+	}
+	f->vtime += ns;
+	w = f->worker;
+	if (w->heap_nr && f->vtime > w->heap[0]->when + SIM_QUANTUM_NS)
+		fake_fiber_park(f, FIBER_YIELD);
+}
+
+/*
+ * Run the next event, if it is due by limit: wake up a fiber whose
+ * deadline has come, or switch to the runnable fiber with the earliest
+ * virtual time. Returns false if there was no such event.
+ */
+static bool fake_fiber_step(u64 limit)
+{
+	struct fake_fiber_worker *w;
+	struct fake_fiber *f, host;
+	bool ran = false;
+
+	pthread_once(&fake_fiber_once, fake_fiber_init);
+	w = &fake_fiber_workers[0];
+	fake_fiber_save(&host);
+	host.tid = fake_tid;
+	(pthread_mutex_lock)(&fake_fiber_lock);
+	while (w->heap_nr && w->heap[0]->when <= limit) {
+		f = w->heap[0];
+		if (f->waiting) {
+			if (f->vtime < f->when)
+				f->vtime = f->when;
+			fake_fiber_unwait(f);
+			continue;
+		}
+		fake_fiber_heap_del(w, f);
+		fake_fiber_run(w, f);
+		ran = true;
+		break;
+	}
+	(pthread_mutex_unlock)(&fake_fiber_lock);
+	fake_fiber_restore(&host);
+	return ran;
+}
+#endif /* #ifdef PCT */
+
+/* The main thread waits on a lock or futex that no fiber will release */
+static void fake_fiber_deadlock(void)
+{
+	printf("Simulation deadlock at %llu ns\n", fake_sim_now);
+	abort();
+}
+
+/* Run the fibers while *uaddr == val (if uaddr), or until ns (if ns) */
+static void fake_fiber_host_wait(unsigned int *uaddr, unsigned int val,
+				 u64 ns)
+{
+	fake_pct_host_wait(true);
+	while ((!uaddr || __atomic_load_n(uaddr, __ATOMIC_RELAXED) == val) &&
+	       (!ns || fake_sim_now < ns)) {
+		if (fake_fiber_step(ns ? ns : ULLONG_MAX))
+			continue;
+		if (!ns)
+			fake_fiber_deadlock();
+		fake_sim_now = ns;
+	}
+	fake_pct_host_wait(false);
+}
+#endif /* #ifdef SIMULATE */
+
+int fake_fiber_create(pthread_t *t, const pthread_attr_t *attr,
+		      void *(*fn)(void *), void *arg)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	struct fake_fiber *f;
+	char *stack;
+
+	pthread_once(&fake_fiber_once, fake_fiber_init);
+	f = calloc(1, sizeof(*f));
+	if (!f)
+		return EAGAIN;
+	f->stack_size = page + FIBER_STACK_KB * 1024;
+	stack = mmap(NULL, f->stack_size, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (stack == MAP_FAILED) {
+		free(f);
+		return EAGAIN;
+	}
+	/* Guard page */
+	if (mprotect(stack, page, PROT_NONE))
+		abort();
+	f->stack = stack;
+	f->fn = fn;
+	f->arg = arg;
+	f->heap_idx = -1;
+#ifdef SIMULATE
+	f->vtime = fake_clock_ns();
+#endif
+#ifdef PCT
+	f->prio = fake_pct_prio();
+#endif
+	fake_fiber_ctx_init(&f->ctx, stack + page, FIBER_STACK_KB * 1024);
+	*t = (pthread_t) f;
+
+	(pthread_mutex_lock)(&fake_fiber_lock);
+	f->tid = FIBER_TID_BASE | ++fake_fiber_next_id;
+	f->task.pid = f->tid;
+	strcpy(f->task.comm, "task");
+	f->worker = &fake_fiber_workers[fake_fiber_next_id %
+					fake_fiber_nr_workers];
+	f->worker->nr_fibers++;
+	fake_fiber_ready(f);
+	(pthread_mutex_unlock)(&fake_fiber_lock);
+	return 0;
+}
+
+int fake_fiber_join(pthread_t t, void **ret)
+{
+	struct fake_fiber *f = (struct fake_fiber *) t;
+
+	while (!__atomic_load_n(&f->exited, __ATOMIC_SEQ_CST))
+		fake_futex_wait(&f->exited, 0);
+	if (ret)
+		*ret = f->ret;
+	free(f);
+	return 0;
+}
+
+void fake_fiber_exit(void *ret)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	if (!f)
+		(pthread_exit)(ret);
+	f->ret = ret;
+	fake_fiber_park(f, FIBER_EXIT);
+	abort();
+}
+
+int fake_fiber_yield(void)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	if (!f) {
+#ifdef SIMULATE
+		fake_pct_host_wait(true);
+		fake_fiber_step(ULLONG_MAX);
+		fake_pct_host_wait(false);
+		return 0;
+#else
+		return (sched_yield)();
+#endif
+	}
+#ifdef PCT
+	fake_sim_now += SIM_YIELD_NS;
+	f->yielded = true;
+#elif defined(SIMULATE)
+	f->vtime += SIM_YIELD_NS;
+	if (f->worker->heap_nr && f->vtime < f->worker->heap[0]->when)
+		f->vtime = f->worker->heap[0]->when;
+#endif
+	fake_fiber_park(f, FIBER_YIELD);
+	return 0;
+}
+
+void fake_futex_wait_until(unsigned int *uaddr, unsigned int val, u64 ns)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	if (!f) {
+#ifdef SIMULATE
+		fake_fiber_host_wait(uaddr, val, ns);
+		return;
+#endif
+		__atomic_fetch_add(&fake_fiber_host_waiters, 1,
+				   __ATOMIC_SEQ_CST);
+		if (ns)
+			fake_host_futex_wait_until(uaddr, val, ns);
+		else
+			fake_host_futex_wait(uaddr, val);
+		__atomic_fetch_sub(&fake_fiber_host_waiters, 1,
+				   __ATOMIC_RELAXED);
+		return;
+	}
+	f->addr = uaddr;
+	f->val = val;
+	f->deadline = ns;
+	fake_fiber_park(f, FIBER_FUTEX);
+}
+
+void fake_futex_wait(unsigned int *uaddr, unsigned int val)
+{
+	fake_futex_wait_until(uaddr, val, 0);
+}
+
+void fake_futex_wake(unsigned int *uaddr, int nr)
+{
+	nr -= fake_fiber_wake(uaddr, nr);
+	if (nr > 0 && __atomic_load_n(&fake_fiber_host_waiters,
+				      __ATOMIC_RELAXED))
+		fake_host_futex_wake(uaddr, nr);
+}
+
+void fake_sleep_until(u64 ns)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	if (!f) {
+#ifdef SIMULATE
+		fake_fiber_host_wait(NULL, 0, ns ? ns : 1);
+#else
+		fake_host_sleep_until(ns);
+#endif
+		return;
+	}
+	f->addr = NULL;
+	f->deadline = ns ? ns : 1;
+	fake_fiber_park(f, FIBER_FUTEX);
+}
+
+/*
+ * Lock l with op, parking the current fiber while l is taken (in
+ * simulation mode, the main thread runs the fibers in the meantime).
+ */
+static int fake_fiber_lock_slow(void *l, int op)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+#ifdef SIMULATE
+	if (!f) {
+		fake_pct_host_wait(true);
+		while (!fake_fiber_trylock(l, op))
+			if (!fake_fiber_step(ULLONG_MAX))
+				fake_fiber_deadlock();
+		fake_pct_host_wait(false);
+		return 0;
+	}
+#endif
+	f->addr = l;
+	f->deadline = 0;
+	f->acquired = false;
+	do
+		fake_fiber_park(f, op);
+	while (!f->acquired);
+	return 0;
+}
+
+int fake_fiber_mutex_lock(pthread_mutex_t *m)
+{
+	if (!fake_fiber_current && !IS_ENABLED(SIMULATE))
+		return (pthread_mutex_lock)(m);
+	if (!(pthread_mutex_trylock)(m))
+		return 0;
+	return fake_fiber_lock_slow(m, FIBER_MUTEX);
+}
+
+int fake_fiber_mutex_unlock(pthread_mutex_t *m)
+{
+	int ret = (pthread_mutex_unlock)(m);
+
+	fake_fiber_wake(m, 1);
+	return ret;
+}
+
+int fake_fiber_rwlock_rdlock(pthread_rwlock_t *l)
+{
+	if (!fake_fiber_current && !IS_ENABLED(SIMULATE))
+		return (pthread_rwlock_rdlock)(l);
+	if (!(pthread_rwlock_tryrdlock)(l))
+		return 0;
+	return fake_fiber_lock_slow(l, FIBER_RDLOCK);
+}
+
+int fake_fiber_rwlock_wrlock(pthread_rwlock_t *l)
+{
+	if (!fake_fiber_current && !IS_ENABLED(SIMULATE))
+		return (pthread_rwlock_wrlock)(l);
+	if (!(pthread_rwlock_trywrlock)(l))
+		return 0;
+	return fake_fiber_lock_slow(l, FIBER_WRLOCK);
+}
+
+int fake_fiber_rwlock_unlock(pthread_rwlock_t *l)
+{
+	int ret = (pthread_rwlock_unlock)(l);
+
+	fake_fiber_wake(l, INT_MAX);
+	return ret;
+}
+
+/* The task of the current fiber, NULL on a host thread */
+struct task_struct *fake_fiber_task(void)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	return f ? &f->task : NULL;
+}
+
+/* Time the current fiber has spent running so far */
+u64 fake_fiber_cpu_ns(void)
+{
+	struct fake_fiber *f = fake_fiber_current;
+
+	return f ? f->run_ns + fake_host_clock_ns() - fake_fiber_since : 0;
+}
+
+/*
+ * Print, for each worker, how many fibers it was given, how many times
+ * it switched to one of them, and how many times it ran out of fibers to
+ * run and went to sleep.
+ */
+void fake_dump_fiber_stats(void)
+{
+	struct fake_fiber_worker *w;
+	int i;
+
+	printf("Fiber statistics (%d workers, %d KB stacks):\n",
+	       fake_fiber_nr_workers, FIBER_STACK_KB);
+	for (i = 0; i < fake_fiber_nr_workers; i++) {
+		w = &fake_fiber_workers[i];
+		printf("worker %-3d fibers %6lu switches %10lu idle %8lu\n",
+		       i, w->nr_fibers, w->nr_switches, w->nr_idle);
+	}
+}
+
+#endif /* __FAKE_FIBER_H */
@@ -0,0 +1,341 @@
+/*
+ * CPU hotplug emulation for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_HOTPLUG_H
+#define __FAKE_HOTPLUG_H
+
+/*
+ * Under Nidhugg, all CPUs stay online. Natively, fake_cpu_down() and
+ * fake_cpu_up() take an emulated CPU offline and bring it back online,
+ * invoking RCU's hotplug callbacks in the order and on the CPU the
+ * kernel's hotplug state machine would:
+ *
+ *	down:	rcutree_offline_cpu()	control CPU
+ *		rcutree_dying_cpu()	outgoing CPU, under stop_machine()
+ *		rcu_report_dead()	outgoing CPU, from its idle loop
+ *		rcutree_dead_cpu()	control CPU
+ *	up:	rcutree_prepare_cpu()	control CPU
+ *		rcu_cpu_starting()	incoming CPU, irqs disabled
+ *		rcutree_online_cpu()	control CPU
+ *
+ * Transitions are serialized by cpu_hotplug_lock. stop_machine() is
+ * emulated by taking the CPU lock of every CPU, so that no task runs
+ * while the outgoing CPU is marked offline. Tasks that want to run on an
+ * offline CPU move to the next online one instead (see fake_acquire_cpu()),
+ * and offline CPUs take no interrupts.
+ *
+ * fake_start_hotplug() starts a driver kthread on HOTPLUG_CTRL_CPU, which
+ * takes the other CPUs offline in turn: each one stays offline for
+ * HOTPLUG_OFFLINE_MS milliseconds, and a new transition starts every
+ * HOTPLUG_PERIOD_MS milliseconds after the previous CPU came back.
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 9, 0)
+/*
+ * Before v4.9, RCU follows hotplug through rcu_cpu_notify(), so each of
+ * the callbacks above becomes the corresponding CPU notifier event.
+ */
+# define fake_rcu_cpu_notify(action, cpu)				\
+	rcu_cpu_notify(NULL, action, (void *)(long)(cpu))
+# define rcutree_offline_cpu(cpu) fake_rcu_cpu_notify(CPU_DOWN_PREPARE, cpu)
+# define rcutree_dying_cpu(cpu) fake_rcu_cpu_notify(CPU_DYING, cpu)
+# define rcutree_dead_cpu(cpu) fake_rcu_cpu_notify(CPU_DEAD, cpu)
+# define rcutree_prepare_cpu(cpu) fake_rcu_cpu_notify(CPU_UP_PREPARE, cpu)
+# define rcu_cpu_starting(cpu) do { } while (0)
+# define rcutree_online_cpu(cpu) fake_rcu_cpu_notify(CPU_ONLINE, cpu)
+# if LINUX_VERSION_CODE < KERNEL_VERSION(4, 7, 0)
+#  define rcu_report_dead(cpu) fake_rcu_cpu_notify(CPU_DYING_IDLE, cpu)
+# endif
+#endif
+
+#ifndef HOTPLUG_CTRL_CPU
+# define HOTPLUG_CTRL_CPU 0
+#endif
+#ifndef HOTPLUG_OFFLINE_MS
+# define HOTPLUG_OFFLINE_MS 10
+#endif
+#ifndef HOTPLUG_PERIOD_MS
+# define HOTPLUG_PERIOD_MS 20
+#endif
+
+struct fake_hotplug_stats {
+	unsigned long nr;		/* Completed transitions */
+	u64 ns;				/* Total time they took */
+	u64 min_ns;
+	u64 max_ns;
+};
+
+struct fake_hotplug_stats fake_cpu_down_stats = { .min_ns = ULLONG_MAX };
+struct fake_hotplug_stats fake_cpu_up_stats = { .min_ns = ULLONG_MAX };
+
+/* Callbacks left on outgoing CPUs, handed over by rcutree_dead_cpu() */
+unsigned long fake_hotplug_cbs;
+unsigned long fake_hotplug_max_cbs;
+
+/*
+ * Bumped when a CPU starts going offline and when it is back online, so
+ * fake_hotplug_events is odd whenever some CPU is not fully online.
+ */
+unsigned int fake_hotplug_events;
+
+/*
+ * As in the kernel, a task that blocks on cpu_hotplug_lock sleeps, i.e.,
+ * gives up its CPU until the ongoing transition is over.
+ */
+void fake_get_online_cpus(void)
+{
+	if (!pthread_rwlock_tryrdlock(&cpu_hotplug_lock))
+		return;
+	fake_release_cpu(get_cpu());
+	if (pthread_rwlock_rdlock(&cpu_hotplug_lock))
+		exit(-1);
+	fake_acquire_cpu(get_cpu());
+}
+
+static void fake_cpu_hotplug_begin(void)
+{
+	fake_release_cpu(get_cpu());
+	if (pthread_rwlock_wrlock(&cpu_hotplug_lock))
+		exit(-1);
+	fake_acquire_cpu(get_cpu());
+}
+
+static void fake_cpu_hotplug_done(void)
+{
+	if (pthread_rwlock_unlock(&cpu_hotplug_lock))
+		exit(-1);
+}
+
+/*
+ * Take (or release) the CPU lock of every CPU except the current one,
+ * waiting for the tasks running there to reach a scheduling point. No
+ * deadlock is possible since other tasks never hold two CPU locks.
+ */
+static void fake_stop_machine_begin(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		if (cpu != get_cpu() && pthread_mutex_lock(&cpu_lock[cpu]))
+			exit(-1);
+}
+
+static void fake_stop_machine_end(int skip)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpu_ids; cpu++)
+		if (cpu != get_cpu() && cpu != skip &&
+		    pthread_mutex_unlock(&cpu_lock[cpu]))
+			exit(-1);
+}
+
+static void fake_hotplug_account(struct fake_hotplug_stats *st, u64 start)
+{
+	u64 delta = fake_clock_ns() - start;
+
+	st->nr++;
+	st->ns += delta;
+	if (delta < st->min_ns)
+		st->min_ns = delta;
+	if (delta > st->max_ns)
+		st->max_ns = delta;
+}
+
+/*
+ * Take cpu offline. Must be called from another CPU, with that CPU
+ * held. Returns -EINVAL if cpu is already offline or is the last CPU
+ * online.
+ */
+int fake_cpu_down(int cpu)
+{
+	struct task_struct *prev;
+	struct rcu_state *rsp;
+	unsigned long cbs = 0;
+	int ctrl = get_cpu();
+	u64 start;
+
+	fake_cpu_hotplug_begin();
+	if (cpu == ctrl || !cpu_online(cpu) || num_online_cpus() == 1) {
+		fake_cpu_hotplug_done();
+		return -EINVAL;
+	}
+	__atomic_fetch_add(&fake_hotplug_events, 1, __ATOMIC_SEQ_CST);
+	start = fake_clock_ns();
+	rcutree_offline_cpu(cpu);
+
+	/* take_cpu_down(), on the outgoing CPU under stop_machine() */
+	fake_stop_machine_begin();
+	set_cpu(cpu);
+	prev = current;
+	current = idle_task(cpu);
+	fake_rcu_idle_exit();
+	current = prev;
+	local_irq_disable();
+	rcutree_dying_cpu(cpu);
+	cpumask_clear_cpu(cpu, cpu_online_mask);
+	smp_mb();
+	fake_run_ipis();
+	local_irq_enable();
+	set_cpu(ctrl);
+	fake_stop_machine_end(cpu);
+
+	/* The outgoing CPU's idle loop reports it dead */
+	set_cpu(cpu);
+	rcu_report_dead(cpu);
+	if (pthread_mutex_unlock(&cpu_lock[cpu]))
+		exit(-1);
+	set_cpu(ctrl);
+
+	for_each_rcu_flavor(rsp)
+		cbs += per_cpu_ptr(rsp->rda, cpu)->qlen;
+	fake_hotplug_cbs += cbs;
+	if (cbs > fake_hotplug_max_cbs)
+		fake_hotplug_max_cbs = cbs;
+	rcutree_dead_cpu(cpu);
+
+	fake_hotplug_account(&fake_cpu_down_stats, start);
+	fake_cpu_hotplug_done();
+	return 0;
+}
+
+/*
+ * Bring cpu back online. Must be called from another CPU, with that CPU
+ * held. Returns -EINVAL if cpu is already online.
+ */
+int fake_cpu_up(int cpu)
+{
+	struct task_struct *prev;
+	int ctrl = get_cpu();
+	u64 start;
+
+	fake_cpu_hotplug_begin();
+	if (cpu == ctrl || cpu_online(cpu)) {
+		fake_cpu_hotplug_done();
+		return -EINVAL;
+	}
+	start = fake_clock_ns();
+	rcutree_prepare_cpu(cpu);
+
+	/* The incoming CPU marks itself online and goes idle */
+	set_cpu(cpu);
+	if (pthread_mutex_lock(&cpu_lock[cpu]))
+		exit(-1);
+	local_irq_disable();
+	rcu_cpu_starting(cpu);
+	cpumask_set_cpu(cpu, cpu_online_mask);
+	smp_mb();
+	local_irq_enable();
+	prev = current;
+	current = idle_task(cpu);
+	fake_rcu_idle_enter();
+	current = prev;
+	if (pthread_mutex_unlock(&cpu_lock[cpu]))
+		exit(-1);
+	set_cpu(ctrl);
+
+	rcutree_online_cpu(cpu);
+	fake_hotplug_account(&fake_cpu_up_stats, start);
+	__atomic_fetch_add(&fake_hotplug_events, 1, __ATOMIC_SEQ_CST);
+	fake_cpu_hotplug_done();
+	return 0;
+}
+
+/*
+ * Unlike schedule_timeout(), this does not make a kthread that is being
+ * stopped exit, so the driver always brings its CPU back online.
+ */
+static void fake_hotplug_sleep(u64 ms)
+{
+	fake_release_cpu(get_cpu());
+	fake_sleep_until(fake_clock_ns() + ms * 1000000ULL);
+	fake_acquire_cpu(get_cpu());
+}
+
+static int fake_hotplug_kthread(void *data)
+{
+	int cpu = HOTPLUG_CTRL_CPU;
+
+	while (!kthread_should_stop()) {
+		do
+			cpu = (cpu + 1) % nr_cpu_ids;
+		while (cpu == HOTPLUG_CTRL_CPU);
+		if (!fake_cpu_down(cpu)) {
+			fake_hotplug_sleep(HOTPLUG_OFFLINE_MS);
+			fake_cpu_up(cpu);
+		}
+		schedule_timeout_interruptible(
+			DIV_ROUND_UP(HOTPLUG_PERIOD_MS * HZ, 1000));
+	}
+	return 0;
+}
+
+/*
+ * Start the hotplug driver. It is stopped by fake_stop_kthreads(), once
+ * all CPUs are back online.
+ */
+void fake_start_hotplug(void)
+{
+	struct task_struct *t;
+
+	BUILD_BUG_ON(NR_CPUS < 2);
+	t = kthread_create(fake_hotplug_kthread, NULL, "cpuhp_driver");
+	kthread_bind(t, HOTPLUG_CTRL_CPU);
+	wake_up_process(t);
+}
+
+static void fake_print_hotplug_stats(const char *name,
+				     struct fake_hotplug_stats *st)
+{
+	printf("%-8s %6lu transitions, cost min %llu avg %llu max %llu ns\n",
+	       name, st->nr, st->nr ? st->min_ns : 0,
+	       st->nr ? st->ns / st->nr : 0, st->max_ns);
+}
+
+/*
+ * Print the number and cost of the CPU transitions, the callbacks that
+ * were left on the outgoing CPUs, and, for each flavor, how many
+ * callbacks were orphaned and adopted and how many quiescent states
+ * were reported by force_quiescent_state() on behalf of offline CPUs.
+ */
+void fake_dump_hotplug_stats(void)
+{
+	struct rcu_state *rsp;
+	struct rcu_data *rdp;
+	unsigned long orphaned, adopted, ofl;
+	int cpu;
+
+	printf("Hotplug statistics (offline %d ms, period %d ms):\n",
+	       HOTPLUG_OFFLINE_MS, HOTPLUG_PERIOD_MS);
+	fake_print_hotplug_stats("offline", &fake_cpu_down_stats);
+	fake_print_hotplug_stats("online", &fake_cpu_up_stats);
+	printf("callbacks on outgoing CPUs: %lu (max %lu)\n",
+	       fake_hotplug_cbs, fake_hotplug_max_cbs);
+	for_each_rcu_flavor(rsp) {
+		orphaned = adopted = ofl = 0;
+		for_each_possible_cpu(cpu) {
+			rdp = per_cpu_ptr(rsp->rda, cpu);
+			orphaned += rdp->n_cbs_orphaned;
+			adopted += rdp->n_cbs_adopted;
+			ofl += rdp->offline_fqs;
+		}
+		printf("%-10s orphaned %8lu adopted %8lu offline FQS %8lu\n",
+		       rsp->name, orphaned, adopted, ofl);
+	}
+}
+
+#endif /* __FAKE_HOTPLUG_H */
@@ -0,0 +1,374 @@
+/*
+ * Kthread registry for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_KTHREAD_H
+#define __FAKE_KTHREAD_H
+
+/*
+ * Under Nidhugg, kthread_run() is routed to spawn_gp_kthread() or
+ * spawn_nocb_kthread() depending on its number of arguments, and the
+ * tests provide the thread bodies. Natively, every kthread created by
+ * RCU is entered in a registry instead, and is run by a generic thread
+ * body: it sets current to the kthread's task_struct, runs on (i.e.,
+ * holds the CPU lock of) a CPU chosen according to its thread function,
+ * and follows kthread_bind() and set_cpus_allowed_ptr() to other CPUs.
+ *
+ * For each kthread, the time it spent holding its CPU and the host CPU
+ * time it consumed are accounted. fake_stop_kthreads() stops all
+ * kthreads at the end of a run: since RCU's kthreads never check
+ * kthread_should_stop(), they are made to exit the next time they sleep
+ * in one of the wait functions, with their CPU released.
+ */
+#ifndef KTHREAD_CPU
+# define KTHREAD_CPU 0
+#endif
+
+/* How long fake_stop_kthreads() waits for a kthread to exit, in ms */
+#define KTHREAD_STOP_TIMEOUT_MS 1000
+
+struct fake_kthread {
+	struct fake_kthread *next;
+	struct task_struct task;
+	int (*threadfn)(void *data);
+	void *data;
+	struct smp_hotplug_thread *ht;	/* Per-CPU (smpboot) kthreads only */
+	int cpu;			/* CPU the kthread is bound to */
+	pthread_t tid;
+	int started;
+	int should_stop;
+	unsigned int *wait_uaddr;	/* Futex word it last slept on */
+	unsigned int wakeups;		/* Bumped by wake_up_process() */
+	unsigned int exited;
+
+	/* Accounting */
+	unsigned long nr_runs;		/* Times it got hold of its CPU */
+	u64 oncpu_since;
+	u64 oncpu_ns;			/* Time spent holding its CPU */
+	u64 cpu_ns;			/* Host CPU time, set upon exit */
+};
+
+/*
+ * The kthreads RCU knows about, along with the CPU that each one starts
+ * out on. Unknown thread functions start out on KTHREAD_CPU, as do the
+ * unbound kthreads.
+ */
+struct fake_kthread_type {
+	int (*threadfn)(void *data);
+	int (*cpu)(void *data);
+};
+
+static int fake_kthread_cpu_default(void *data)
+{
+	return KTHREAD_CPU;
+}
+
+#ifdef CONFIG_RCU_BOOST
+/* Boost kthreads start out on the first CPU of their rcu_node */
+static int fake_boost_kthread_cpu(void *data)
+{
+	struct rcu_node *rnp = data;
+
+	return rnp->grplo;
+}
+#endif
+
+static const struct fake_kthread_type fake_kthread_types[] = {
+	{ rcu_gp_kthread, fake_kthread_cpu_default },
+#ifdef CONFIG_RCU_BOOST
+	{ rcu_boost_kthread, fake_boost_kthread_cpu },
+#endif
+#ifdef CONFIG_RCU_NOCB_CPU
+	{ rcu_nocb_kthread, fake_kthread_cpu_default },
+#endif
+#ifdef CONFIG_TASKS_RCU
+	{ rcu_tasks_kthread, fake_kthread_cpu_default },
+#endif
+};
+
+struct fake_kthread *fake_kthread_list;
+static struct fake_kthread **fake_kthread_tail = &fake_kthread_list;
+pthread_mutex_t fake_kthread_lock = PTHREAD_MUTEX_INITIALIZER;
+static int fake_kthread_next_pid = 1;
+static struct fake_kthread __thread *fake_kthread_self;
+
+#define to_fake_kthread(t) container_of(t, struct fake_kthread, task)
+
+static struct fake_kthread *fake_kthread_alloc(int cpu, const char namefmt[],
+					       va_list ap)
+{
+	struct fake_kthread *kt = calloc(1, sizeof(*kt));
+
+	if (!kt)
+		abort();
+	vsnprintf(kt->task.comm, sizeof(kt->task.comm), namefmt, ap);
+	kt->cpu = cpu;
+	if (pthread_mutex_lock(&fake_kthread_lock))
+		exit(-1);
+	kt->task.pid = fake_kthread_next_pid++;
+	*fake_kthread_tail = kt;
+	fake_kthread_tail = &kt->next;
+	if (pthread_mutex_unlock(&fake_kthread_lock))
+		exit(-1);
+	return kt;
+}
+
+/*
+ * Called by a kthread that is about to exit, with its CPU released.
+ */
+void fake_kthread_exit(void)
+{
+	struct fake_kthread *kt = fake_kthread_self;
+#ifdef FIBERS
+	kt->cpu_ns = fake_fiber_cpu_ns();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	kt->cpu_ns = (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+	__atomic_store_n(&kt->exited, 1, __ATOMIC_SEQ_CST);
+	fake_futex_wake(&kt->exited, INT_MAX);
+	pthread_exit(NULL);
+}
+
+bool kthread_should_stop(void)
+{
+	return fake_kthread_self &&
+	       __atomic_load_n(&fake_kthread_self->should_stop,
+			       __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Sleep on uaddr as long as it reads val, unless the current kthread
+ * has been asked to stop. The futex word is published so that
+ * fake_stop_kthreads() can wake the kthread up.
+ */
+void fake_kthread_wait(unsigned int *uaddr, unsigned int val)
+{
+	if (fake_kthread_self) {
+		__atomic_store_n(&fake_kthread_self->wait_uaddr, uaddr,
+				 __ATOMIC_SEQ_CST);
+		if (kthread_should_stop())
+			return;
+	}
+	fake_futex_wait(uaddr, val);
+}
+
+/* Move the current kthread to the CPU it is bound to, if need be */
+int fake_kthread_migrate(int cpu)
+{
+	struct fake_kthread *kt = fake_kthread_self;
+	int target;
+
+	if (!kt)
+		return cpu;
+	target = READ_ONCE(kt->cpu);
+	if (target != cpu)
+		set_cpu(target);
+	return target;
+}
+
+/* Called whenever the current thread gets hold of, or releases, its CPU */
+void fake_kthread_account(int oncpu)
+{
+	struct fake_kthread *kt = fake_kthread_self;
+
+	if (!kt)
+		return;
+	if (oncpu) {
+		kt->nr_runs++;
+		kt->oncpu_since = fake_clock_ns();
+	} else {
+		kt->oncpu_ns += fake_clock_ns() - kt->oncpu_since;
+	}
+}
+
+static void *fake_kthread_body(void *arg)
+{
+	struct fake_kthread *kt = arg;
+
+	fake_kthread_self = kt;
+	current = &kt->task;
+	set_cpu(kt->cpu);
+
+	fake_acquire_cpu(get_cpu());
+	kt->threadfn(kt->data);
+	fake_release_cpu(get_cpu());
+
+	fake_kthread_exit();
+	return NULL;
+}
+
+/*
+ * Register a kthread running threadfn(data). As in the kernel, it does
+ * not run until it is first woken up with wake_up_process().
+ */
+struct task_struct *fake_kthread_create(int (*threadfn)(void *data),
+					void *data, const char namefmt[], ...)
+{
+	struct fake_kthread *kt;
+	va_list ap;
+	int cpu = KTHREAD_CPU;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fake_kthread_types); i++)
+		if (fake_kthread_types[i].threadfn == threadfn)
+			cpu = fake_kthread_types[i].cpu(data);
+	va_start(ap, namefmt);
+	kt = fake_kthread_alloc(cpu, namefmt, ap);
+	va_end(ap);
+	kt->threadfn = threadfn;
+	kt->data = data;
+	return &kt->task;
+}
+
+int wake_up_process(struct task_struct *t)
+{
+	struct fake_kthread *kt = to_fake_kthread(t);
+
+	if (!__atomic_exchange_n(&kt->started, 1, __ATOMIC_SEQ_CST)) {
+		if (pthread_create(&kt->tid, NULL, fake_kthread_body, kt))
+			abort();
+		t->tid = kt->tid;
+		return 1;
+	}
+	fake_wake_up(&kt->wakeups, 1);
+	return 1;
+}
+
+/* Bind t to cpu; a running kthread moves when it next gets a CPU */
+void kthread_bind(struct task_struct *t, unsigned int cpu)
+{
+	WRITE_ONCE(to_fake_kthread(t)->cpu, cpu);
+}
+
+/* Natively, a kthread is bound to the first CPU in its affinity mask */
+int set_cpus_allowed_ptr(struct task_struct *t, cpumask_var_t mask)
+{
+	int cpu = cpumask_next(-1, mask);
+
+	if (cpu >= nr_cpu_ids)
+		return -EINVAL;
+	kthread_bind(t, cpu);
+	return 0;
+}
+
+/*
+ * Per-CPU kthreads (smpboot): the kthread of each CPU sleeps until
+ * woken up with wake_up_process(), and then calls ->thread_fn() as long
+ * as ->thread_should_run() says so.
+ */
+static int fake_smpboot_thread_fn(void *data)
+{
+	struct fake_kthread *kt = fake_kthread_self;
+	struct smp_hotplug_thread *ht = kt->ht;
+	unsigned int seq;
+
+	if (ht->setup)
+		ht->setup(kt->cpu);
+	for (;;) {
+		seq = __atomic_load_n(&kt->wakeups, __ATOMIC_SEQ_CST);
+		if (ht->thread_should_run(kt->cpu)) {
+			ht->thread_fn(kt->cpu);
+			continue;
+		}
+		fake_release_cpu(get_cpu());
+		while (__atomic_load_n(&kt->wakeups, __ATOMIC_SEQ_CST) == seq &&
+		       !kthread_should_stop())
+			fake_kthread_wait(&kt->wakeups, seq);
+		if (kthread_should_stop()) {
+			if (ht->park)
+				ht->park(kt->cpu);
+			fake_kthread_exit();
+		}
+		fake_acquire_cpu(get_cpu());
+	}
+	return 0;
+}
+
+int smpboot_register_percpu_thread(struct smp_hotplug_thread *ht)
+{
+	struct task_struct *t;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		t = fake_kthread_create(fake_smpboot_thread_fn, NULL,
+					ht->thread_comm, cpu);
+		to_fake_kthread(t)->cpu = cpu;
+		to_fake_kthread(t)->ht = ht;
+		(*ht->store)[cpu] = t;
+		wake_up_process(t);
+	}
+	return 0;
+}
+
+/*
+ * Stop all kthreads and wait for them to exit. A kthread that does not
+ * exit within KTHREAD_STOP_TIMEOUT_MS (e.g., because it is blocked on
+ * a mutex) is left alone.
+ */
+void fake_stop_kthreads(void)
+{
+	struct fake_kthread *kt;
+	unsigned int *uaddr;
+	u64 deadline;
+
+	for (kt = fake_kthread_list; kt; kt = kt->next) {
+		if (!kt->started)
+			continue;
+		__atomic_store_n(&kt->should_stop, 1, __ATOMIC_SEQ_CST);
+		deadline = fake_clock_ns() + KTHREAD_STOP_TIMEOUT_MS * 1000000ULL;
+		while (!__atomic_load_n(&kt->exited, __ATOMIC_SEQ_CST)) {
+			if (fake_clock_ns() >= deadline) {
+				printf("kthread %s did not stop\n",
+				       kt->task.comm);
+				break;
+			}
+			/* Only wake -- uaddr may no longer be in use */
+			uaddr = __atomic_load_n(&kt->wait_uaddr,
+						__ATOMIC_SEQ_CST);
+			if (uaddr)
+				fake_futex_wake(uaddr, INT_MAX);
+			fake_futex_wait_until(&kt->exited, 0,
+					      fake_clock_ns() + 1000000ULL);
+		}
+		if (kt->exited && pthread_join(kt->tid, NULL))
+			abort();
+	}
+}
+
+/*
+ * Print the kthreads that have been started: their CPU, how many times
+ * and for how long they held their CPU, and the host CPU time they
+ * consumed (known once they have been stopped).
+ */
+void fake_dump_kthread_stats(void)
+{
+	struct fake_kthread *kt;
+
+	printf("Kthread statistics:\n");
+	for (kt = fake_kthread_list; kt; kt = kt->next) {
+		if (!kt->started)
+			continue;
+		printf("%-20s pid %-4d cpu %-4d runs %8lu on-CPU %12llu ns host CPU %12llu ns\n",
+		       kt->task.comm, kt->task.pid, kt->cpu, kt->nr_runs,
+		       kt->oncpu_ns, kt->cpu_ns);
+	}
+}
+
+#endif /* __FAKE_KTHREAD_H */
@@ -0,0 +1,313 @@
+/*
+ * Support for running the scaffolded environment natively on the host.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_NATIVE_H
+#define __FAKE_NATIVE_H
+
+/*
+ * The definitions in this file are only used when the tests are compiled
+ * with -DNATIVE, i.e., when they are run directly on the host at full speed
+ * instead of being explored by Nidhugg. The busy-waiting done in the
+ * fake_*.h files is fine under Nidhugg's spin-assume transformation, but
+ * natively it makes every waiting thread burn a host core. In native mode,
+ * waits are therefore turned into real sleeps on futexes.
+ *
+ * <linux/futex.h> cannot be included here, as it would pick up the (empty)
+ * kernel headers under the version's directory.
+ */
+#define FUTEX_WAIT_PRIVATE	128
+#define FUTEX_WAKE_PRIVATE	129
+#define FUTEX_WAIT_BITSET_PRIVATE	137
+#define FUTEX_BITSET_MATCH_ANY	0xffffffff
+
+/*
+ * Sleep as long as *uaddr == val. Spurious wakeups are possible, so callers
+ * always have to re-check the condition they are waiting for.
+ */
+static inline void fake_host_futex_wait(unsigned int *uaddr, unsigned int val)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+/*
+ * Like fake_host_futex_wait(), but give up once the host monotonic clock
+ * reaches ns.
+ */
+static inline void fake_host_futex_wait_until(unsigned int *uaddr,
+					      unsigned int val, u64 ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	syscall(SYS_futex, uaddr, FUTEX_WAIT_BITSET_PRIVATE, val, &ts, NULL,
+		FUTEX_BITSET_MATCH_ANY);
+}
+
+/*
+ * Wake at most nr threads sleeping on uaddr. Note that no memory is written
+ * here, so it is safe to call this on an address that may have gone away
+ * (e.g., an on-stack completion whose waiter has already returned).
+ */
+static inline void fake_host_futex_wake(unsigned int *uaddr, int nr)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+/* Hint to the host CPU that we are busy-waiting */
+#if defined(__x86_64__) || defined(__i386__)
+# define fake_cpu_relax() __builtin_ia32_pause()
+#else
+# define fake_cpu_relax() barrier()
+#endif
+
+/* Host monotonic clock, in nanoseconds */
+static inline u64 fake_host_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sleep until the host monotonic clock reaches ns */
+static inline void fake_host_sleep_until(u64 ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+		;
+}
+
+/*
+ * -DPCT runs the fibers of a simulation (which it implies) under a
+ * randomized priority scheduler, with preemption points at marked
+ * accesses, atomics and locks (see fake_pct.h).
+ */
+#ifdef PCT
+# ifndef SIMULATE
+#  define SIMULATE
+# endif
+# ifndef PCT_DEPTH
+#  define PCT_DEPTH 3
+# endif
+# ifndef PCT_STEPS
+#  define PCT_STEPS 400
+# endif
+# ifndef PCT_DELAY_JIFFIES
+#  define PCT_DELAY_JIFFIES 100
+# endif
+u64 fake_pct_prio(void);
+#endif
+
+/*
+ * -DSIMULATE runs fibers in virtual time, charging atomics, lock
+ * acquisitions and full barriers for the cache-line transfers they cause
+ * (see fake_sim.h). fake_clock_ns() then returns the virtual time of the
+ * current fiber.
+ */
+#ifdef SIMULATE
+# ifndef FIBERS
+#  define FIBERS
+# endif
+u64 fake_clock_ns(void);
+void fake_sim_rmw(const volatile void *addr);
+void fake_sim_mb(void);
+#else /* #ifdef SIMULATE */
+# define fake_clock_ns() fake_host_clock_ns()
+#endif /* #ifdef SIMULATE */
+
+#ifdef FIBERS
+/*
+ * With -DFIBERS, the threads created with pthread_create() are fibers
+ * multiplexed over a few host threads (see fake_fiber.h), and the wait
+ * primitives, the pthread locks and sched_yield() switch to another fiber
+ * instead of blocking the host thread. The implementation calls the host
+ * functions as (pthread_mutex_lock)(m) and so on.
+ */
+void fake_futex_wait(unsigned int *uaddr, unsigned int val);
+void fake_futex_wait_until(unsigned int *uaddr, unsigned int val, u64 ns);
+void fake_futex_wake(unsigned int *uaddr, int nr);
+void fake_sleep_until(u64 ns);
+
+int fake_fiber_create(pthread_t *t, const pthread_attr_t *attr,
+		      void *(*fn)(void *), void *arg);
+int fake_fiber_join(pthread_t t, void **ret);
+void fake_fiber_exit(void *ret) __attribute__((noreturn));
+int fake_fiber_yield(void);
+int fake_fiber_mutex_lock(pthread_mutex_t *m);
+int fake_fiber_mutex_unlock(pthread_mutex_t *m);
+int fake_fiber_rwlock_rdlock(pthread_rwlock_t *l);
+int fake_fiber_rwlock_wrlock(pthread_rwlock_t *l);
+int fake_fiber_rwlock_unlock(pthread_rwlock_t *l);
+u64 fake_fiber_cpu_ns(void);
+struct task_struct *fake_fiber_task(void);
+
+# define pthread_create(t, attr, fn, arg) fake_fiber_create(t, attr, fn, arg)
+# define pthread_join(t, ret) fake_fiber_join(t, ret)
+# define pthread_exit(ret) fake_fiber_exit(ret)
+# define sched_yield() fake_fiber_yield()
+# define pthread_mutex_lock(m) fake_fiber_mutex_lock(m)
+# define pthread_mutex_unlock(m) fake_fiber_mutex_unlock(m)
+# define pthread_rwlock_rdlock(l) fake_fiber_rwlock_rdlock(l)
+# define pthread_rwlock_wrlock(l) fake_fiber_rwlock_wrlock(l)
+# define pthread_rwlock_unlock(l) fake_fiber_rwlock_unlock(l)
+#else /* #ifdef FIBERS */
+# define fake_futex_wait(uaddr, val) fake_host_futex_wait(uaddr, val)
+# define fake_futex_wait_until(uaddr, val, ns) \
+	fake_host_futex_wait_until(uaddr, val, ns)
+# define fake_futex_wake(uaddr, nr) fake_host_futex_wake(uaddr, nr)
+# define fake_sleep_until(ns) fake_host_sleep_until(ns)
+#endif /* #ifdef FIBERS */
+
+/*
+ * With -DPIN_CPUS, host threads are pinned to host CPUs according to the
+ * rcu_node geometry (see fake_topology.h). With fibers, only the host
+ * threads that run them are.
+ */
+#ifdef PIN_CPUS
+# ifdef FIBERS
+void fake_pin_worker(int i);
+# else
+void fake_pin_cpu(int cpu);
+void fake_pin_housekeeping(int i);
+# endif
+#endif
+#if !defined(PIN_CPUS) || defined(FIBERS)
+# define fake_pin_cpu(cpu) do { } while (0)
+# define fake_pin_housekeeping(i) do { } while (0)
+#endif
+
+/*
+ * With -DATOMIC_STATS, each call site of an atomic operation (see
+ * fake_defs.h) has a struct fake_atomic_site, placed in a section of its
+ * own so that fake_dump_atomic_stats() can find them all, which counts its
+ * calls and the time they took: TSC cycles on x86, host nanoseconds
+ * elsewhere, and virtual nanoseconds (including the cache-line transfers
+ * charged by fake_sim.h) in simulation mode. The counters are updated with
+ * atomics of their own, so the figures are inflated by the measurement,
+ * and are mostly useful to compare call sites with each other.
+ */
+#ifdef ATOMIC_STATS
+struct fake_atomic_site {
+	const char *file;
+	const char *func;
+	int line;
+	int full;		/* Fully ordered, i.e., returns a value */
+	unsigned long count;
+	unsigned long time;
+} ____cacheline_aligned_in_smp;	/* Sizes the section's array slots */
+
+extern struct fake_atomic_site __start_fake_atomic_sites[];
+extern struct fake_atomic_site __stop_fake_atomic_sites[];
+
+# ifdef SIMULATE
+#  define fake_atomic_clock() fake_clock_ns()
+#  define FAKE_ATOMIC_UNIT "ns"
+# elif defined(__x86_64__) || defined(__i386__)
+#  define fake_atomic_clock() __builtin_ia32_rdtsc()
+#  define FAKE_ATOMIC_UNIT "cycles"
+# else
+#  define fake_atomic_clock() fake_host_clock_ns()
+#  define FAKE_ATOMIC_UNIT "ns"
+# endif
+
+# define __fake_atomic_site(is_full)					\
+	static struct fake_atomic_site ___site				\
+		__attribute__((section("fake_atomic_sites"), used)) =	\
+		{ .file = __FILE__, .func = __func__, .line = __LINE__,	\
+		  .full = is_full };					\
+	u64 ___start = fake_atomic_clock()
+# define __fake_atomic_count()						\
+do {									\
+	__atomic_fetch_add(&___site.time,				\
+			   fake_atomic_clock() - ___start,		\
+			   __ATOMIC_RELAXED);				\
+	__atomic_fetch_add(&___site.count, 1, __ATOMIC_RELAXED);	\
+} while (0)
+
+static int fake_atomic_site_cmp(const void *a, const void *b)
+{
+	const struct fake_atomic_site *x = *(void **) a, *y = *(void **) b;
+
+	if (x->time != y->time)
+		return x->time < y->time ? 1 : -1;
+	return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+/*
+ * Print the call sites that ran, by decreasing total time, with "full"
+ * marking the fully ordered operations.
+ */
+void fake_dump_atomic_stats(void)
+{
+	struct fake_atomic_site *site, **sites;
+	int i, n = 0;
+
+	sites = malloc((__stop_fake_atomic_sites - __start_fake_atomic_sites) *
+		       sizeof(*sites));
+	if (!sites)
+		abort();
+	for (site = __start_fake_atomic_sites;
+	     site < __stop_fake_atomic_sites; site++)
+		if (site->count)
+			sites[n++] = site;
+	qsort(sites, n, sizeof(*sites), fake_atomic_site_cmp);
+	printf("Atomic operations by call site (time in %s):\n",
+	       FAKE_ATOMIC_UNIT);
+	for (i = 0; i < n; i++) {
+		site = sites[i];
+		printf("%10lu calls %12lu total %8lu avg %s %s:%d %s()\n",
+		       site->count, site->time, site->time / site->count,
+		       site->full ? "full" : "void", site->file, site->line,
+		       site->func);
+	}
+	free(sites);
+}
+#else /* #ifdef ATOMIC_STATS */
+# define __fake_atomic_site(is_full) do { } while (0)
+# define __fake_atomic_count() do { } while (0)
+#endif /* #ifdef ATOMIC_STATS */
+
+/* CPU time consumed by the whole process so far, in nanoseconds */
+static inline u64 fake_process_cpu_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (u64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * A cheap pseudo-random number generator (xorshift64*). The state must
+ * be seeded with a non-zero value.
+ */
+static inline u64 fake_random(u64 *state)
+{
+	u64 x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+#endif /* __FAKE_NATIVE_H */
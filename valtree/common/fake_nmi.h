@@ -0,0 +1,249 @@
+/*
+ * NMI injection for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_NMI_H
+#define __FAKE_NMI_H
+
+#include <errno.h>
+#include <signal.h>
+
+/*
+ * Natively, fake_start_nmi() starts an injector thread that sends an NMI
+ * to every online CPU NMI_HZ times per second, much like perf sampling
+ * does. The NMI handler calls rcu_nmi_enter(), spins for NMI_HANDLER_NS
+ * nanoseconds (the "sample"), and calls rcu_nmi_exit().
+ *
+ * An NMI has to interrupt whatever runs on its CPU, and everything that
+ * updates the CPU's dynticks state does so with interrupts disabled:
+ *
+ *  - If interrupts are enabled, the CPU is idle or runs a task, and the
+ *    injector takes the NMI itself, on behalf of the CPU, with interrupts
+ *    disabled there.
+ *  - Otherwise, the NMI is sent as a signal to the thread that disabled
+ *    them (see irq_mask[]), which may be in the middle of an interrupt
+ *    handler, of rcu_irq_enter() or of rcu_idle_enter(), and takes the NMI
+ *    in its signal handler. If that thread has enabled interrupts by the
+ *    time the signal arrives, the NMI stays pending and the injector tries
+ *    again.
+ *
+ * NMIs do not nest: a CPU's next NMI is only sent once the previous one
+ * is over. The per-CPU state word, rather than nmi_lock, marks a CPU that
+ * is in an NMI handler, since the signal handler cannot block.
+ */
+#ifndef NMI_HZ
+# define NMI_HZ 1000
+#endif
+#ifndef NMI_HANDLER_NS
+# define NMI_HANDLER_NS 0
+#endif
+/* How long to wait for a signal to be taken before sending it again */
+#define NMI_RETRY_NS 100000ULL
+#define SIGNMI SIGRTMIN
+
+enum {
+	NMI_IDLE,
+	NMI_POSTED,		/* Sent, not taken yet */
+	NMI_RUNNING,		/* Handler running */
+};
+
+struct fake_nmi_cpu {
+	unsigned int state;
+	u64 posted;		/* Time at which the NMI was sent */
+
+	/* Statistics */
+	unsigned long nr;	/* NMIs taken */
+	unsigned long nr_idle;	/* ... that interrupted an RCU-idle CPU */
+	unsigned long nr_irqs_off; /* ... that interrupted irqs-off code */
+	unsigned long nr_hardirq; /* ... that interrupted an irq handler */
+	unsigned long nr_signals; /* Signals sent */
+	unsigned long nr_dropped; /* NMIs dropped as the CPU went offline */
+	u64 latency_ns;		/* Total time from sending to handling */
+	u64 max_latency_ns;
+	u64 rcu_ns;		/* Time in rcu_nmi_enter() and rcu_nmi_exit() */
+	u64 max_rcu_ns;
+	u64 handler_ns;		/* Time in the handler as a whole */
+} ____cacheline_aligned_in_smp;
+
+struct fake_nmi_cpu fake_nmi_cpus[NR_CPUS];
+static pthread_t fake_nmi_thread;
+static int fake_nmi_stop;
+
+static void fake_nmi_handle(int cpu, int irqs_off)
+{
+	struct fake_nmi_cpu *nc = &fake_nmi_cpus[cpu];
+	struct rcu_dynticks *rdtp = this_cpu_ptr(rcu_dynticks);
+	u64 start, entered, exiting, end;
+	unsigned int expected = NMI_POSTED;
+
+	if (!__atomic_compare_exchange_n(&nc->state, &expected, NMI_RUNNING,
+					 false, __ATOMIC_SEQ_CST,
+					 __ATOMIC_RELAXED))
+		return;
+	if (unlikely(cpu_is_offline(cpu))) {
+		nc->nr_dropped++;
+		goto out;
+	}
+
+	start = fake_clock_ns();
+	if (!(atomic_read(&rdtp->dynticks) & 0x1))
+		nc->nr_idle++;
+	nc->nr_irqs_off += irqs_off;
+	nc->nr_hardirq += !!fake_hardirq_count;
+	rcu_nmi_enter();
+	entered = fake_clock_ns();
+#if NMI_HANDLER_NS > 0
+	while (fake_clock_ns() - entered < NMI_HANDLER_NS)
+		fake_cpu_relax();
+#endif
+	exiting = fake_clock_ns();
+	rcu_nmi_exit();
+	end = fake_clock_ns();
+
+	nc->nr++;
+	nc->latency_ns += start - nc->posted;
+	if (start - nc->posted > nc->max_latency_ns)
+		nc->max_latency_ns = start - nc->posted;
+	nc->rcu_ns += (entered - start) + (end - exiting);
+	if ((entered - start) + (end - exiting) > nc->max_rcu_ns)
+		nc->max_rcu_ns = (entered - start) + (end - exiting);
+	nc->handler_ns += end - start;
+out:
+	__atomic_store_n(&nc->state, NMI_IDLE, __ATOMIC_SEQ_CST);
+	fake_futex_wake(&nc->state, 1);
+}
+
+/* Only takes the NMI if interrupts are still disabled by this thread */
+static void fake_nmi_signal(int sig)
+{
+	int saved_errno = errno;
+	int cpu = get_cpu();
+
+	if (fake_irq_owner(cpu) == fake_gettid())
+		fake_nmi_handle(cpu, 1);
+	errno = saved_errno;
+}
+
+/* Send an NMI to cpu and wait until it has been taken */
+static void fake_nmi_send(int cpu)
+{
+	struct fake_nmi_cpu *nc = &fake_nmi_cpus[cpu];
+	u64 retry = 0;
+	unsigned int state;
+	pid_t owner;
+
+	nc->posted = fake_clock_ns();
+	__atomic_store_n(&nc->state, NMI_POSTED, __ATOMIC_SEQ_CST);
+	while ((state = __atomic_load_n(&nc->state, __ATOMIC_SEQ_CST)) !=
+	       NMI_IDLE) {
+		if (state == NMI_POSTED && fake_clock_ns() >= retry) {
+			set_cpu(cpu);
+			if (fake_irq_trylock(cpu)) {
+				fake_nmi_handle(cpu, 0);
+				fake_irq_unlock(cpu);
+				continue;
+			}
+			owner = fake_irq_owner(cpu);
+			if (owner) {
+				syscall(SYS_tgkill, getpid(), owner, SIGNMI);
+				nc->nr_signals++;
+			}
+			retry = fake_clock_ns() + NMI_RETRY_NS;
+		}
+		fake_futex_wait_until(&nc->state, state,
+				      state == NMI_POSTED ? retry :
+				      fake_clock_ns() + NMI_RETRY_NS);
+	}
+}
+
+static void *fake_nmi_injector(void *arg)
+{
+	u64 next = fake_clock_ns();
+	int cpu;
+
+	while (!READ_ONCE(fake_nmi_stop)) {
+		next += 1000000000ULL / NMI_HZ;
+		fake_sleep_until(next);
+		fake_pin_housekeeping(1);
+		for_each_online_cpu(cpu)
+			fake_nmi_send(cpu);
+		if (fake_clock_ns() >= next + 1000000000ULL / NMI_HZ)
+			next = fake_clock_ns();
+	}
+	return NULL;
+}
+
+void fake_start_nmi(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = fake_nmi_signal;
+	sa.sa_flags = SA_RESTART;
+	sigfillset(&sa.sa_mask);
+	if (sigaction(SIGNMI, &sa, NULL))
+		abort();
+	if (pthread_create(&fake_nmi_thread, NULL, fake_nmi_injector, NULL))
+		abort();
+}
+
+/* Stop the injector, once the NMI in flight (if any) has been taken */
+void fake_stop_nmi(void)
+{
+	WRITE_ONCE(fake_nmi_stop, 1);
+	if (pthread_join(fake_nmi_thread, NULL))
+		abort();
+}
+
+/*
+ * Print, for each CPU, how many NMIs it took, how many of them hit it
+ * while RCU-idle, with interrupts disabled and inside an interrupt
+ * handler, how many signals were sent for them, their average/maximum
+ * delivery latency, and their average cost: time in rcu_nmi_enter() and
+ * rcu_nmi_exit(), and in the whole handler. Then print, for each flavor,
+ * how many quiescent states rcu_implicit_dynticks_qs() reported on behalf
+ * of RCU-idle CPUs.
+ */
+void fake_dump_nmi_stats(void)
+{
+	struct fake_nmi_cpu *nc;
+	struct rcu_state *rsp;
+	unsigned long fqs;
+	int cpu;
+
+	printf("NMI statistics (%d Hz, handler %d ns):\n", NMI_HZ,
+	       NMI_HANDLER_NS);
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		nc = &fake_nmi_cpus[cpu];
+		printf("cpu %-4d nmi %8lu idle %8lu irqs-off %8lu hardirq %8lu signals %8lu dropped %4lu lat %8llu/%8llu ns rcu %5llu/%8llu ns handler %6llu ns\n",
+		       cpu, nc->nr, nc->nr_idle, nc->nr_irqs_off,
+		       nc->nr_hardirq, nc->nr_signals, nc->nr_dropped,
+		       nc->nr ? nc->latency_ns / nc->nr : 0,
+		       nc->max_latency_ns,
+		       nc->nr ? nc->rcu_ns / nc->nr : 0, nc->max_rcu_ns,
+		       nc->nr ? nc->handler_ns / nc->nr : 0);
+	}
+	for_each_rcu_flavor(rsp) {
+		fqs = 0;
+		for_each_possible_cpu(cpu)
+			fqs += per_cpu_ptr(rsp->rda, cpu)->dynticks_fqs;
+		printf("%-10s FQS scans %8lu dynticks-idle QSes %8lu\n",
+		       rsp->name, rsp->n_force_qs, fqs);
+	}
+}
+
+#endif /* __FAKE_NMI_H */
@@ -0,0 +1,280 @@
+/*
+ * Randomized priority scheduling of native runs, for bug finding.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_PCT_H
+#define __FAKE_PCT_H
+
+/*
+ * With -DPCT, the fibers of a simulation (see fake_fiber.h) and the main
+ * thread are scheduled as in probabilistic concurrency testing (Burckhardt
+ * et al., ASPLOS 2010): each of them gets a random priority, and the
+ * runnable one with the highest priority runs. Every marked access
+ * (READ_ONCE(), WRITE_ONCE(), ACCESS_ONCE() and their users), every
+ * atomic operation and lock acquisition of the code under test (i.e.,
+ * whatever fake_sim.h charges for) and every fake_acquire_cpu() is a
+ * preemption point. PCT_DEPTH - 1 of them, drawn at random among the first
+ * PCT_STEPS, are change points, at which the thread that reaches them
+ * drops to a priority below all the initial ones, the later change points
+ * giving the lower priorities. A bug that takes d ordering constraints to
+ * show up is then found by a run with probability at least
+ * 1 / (n * PCT_STEPS^(d - 1)) for n threads, if PCT_DEPTH >= d.
+ *
+ * Many bugs of RCU take a thread to be preempted for a grace period or
+ * more, i.e., for many ticks, while the other threads wait for timers.
+ * For PCT_DELAY_JIFFIES after a change point, a thread that was given a
+ * priority at a change point is therefore taken to be preempted: while
+ * only such threads are runnable, the virtual time skips ahead to the next
+ * deadline.
+ *
+ * The schedule only depends on the seed, which is read from the PCT_SEED
+ * environment variable (1 by default), so that one binary can try many
+ * schedules, and a failing one can be replayed. A thread that yields, e.g.,
+ * while spinning, lets every other runnable thread run first, and the
+ * virtual time only skips to the next deadline once every runnable thread
+ * spins. PCT_STEPS should be about the number of preemption points of a
+ * run, which fake_dump_pct_stats() reports (some 400 for litmus.c).
+ *
+ * Without -DIRQ_THREADS, the ticks are the do_IRQ() calls of the threads
+ * themselves, so that the ordering constraints of the FORCE_FAILURE_n
+ * bugs of litmus.c are preemptions at points of the test; native.sh
+ * checks that PCT finds them in that configuration.
+ *
+ * A schedule can also be recorded to, and replayed from, a trace file,
+ * named by the PCT_RECORD and PCT_REPLAY environment variables. Every
+ * preemption point that does not preempt, every fiber that the main
+ * thread switches to, and the main thread going on after it has waited
+ * for the fibers, is a decision; each line of a trace holds the number of
+ * a decision, the id of the thread that runs from then on (0 for the main
+ * thread, n for the n-th thread that it created, as with the <0.n> of
+ * Nidhugg), and the virtual time then (0 if it does not matter). Only the
+ * decisions that differ from the previous one are written out. A replay
+ * makes the same decisions, for the same binary, and goes on under the
+ * priorities once the thread that the trace runs last cannot run, e.g.,
+ * if the trace was written from a counterexample of the model checker
+ * and only holds its prefix.
+ */
+struct fake_pct_event {
+	unsigned long nr;	/* Decision number */
+	unsigned int id;	/* Thread that runs from then on */
+	u64 now;		/* Virtual time then */
+};
+
+static u64 fake_pct_seed;
+static u64 fake_pct_state;
+static pthread_once_t fake_pct_once = PTHREAD_ONCE_INIT;
+/* The change points, in increasing order */
+static unsigned long fake_pct_change[PCT_DEPTH];
+static int fake_pct_next_change;
+/* The trace being replayed, and the next decision of it */
+static struct fake_pct_event *fake_pct_trace;
+static int fake_pct_trace_nr;
+static int fake_pct_trace_pos;
+static bool fake_pct_replaying;
+static FILE *fake_pct_record;
+static struct fake_pct_event fake_pct_last;	/* The last decision */
+
+/* Statistics */
+static unsigned long fake_pct_nr_points;
+static unsigned long fake_pct_nr_preempted;
+static unsigned long fake_pct_nr_decisions;
+static unsigned long fake_pct_nr_replayed;
+
+static int fake_pct_change_cmp(const void *a, const void *b)
+{
+	unsigned long x = *(unsigned long *) a, y = *(unsigned long *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Read the trace at path, and replay it */
+static void fake_pct_load(const char *path)
+{
+	struct fake_pct_event e;
+	int size = 0;
+	char line[128];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		abort();
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' ||
+		    sscanf(line, "%lu %u %llu", &e.nr, &e.id, &e.now) != 3)
+			continue;
+		if (fake_pct_trace_nr == size) {
+			size = size ? 2 * size : 1024;
+			fake_pct_trace = realloc(fake_pct_trace,
+						 size * sizeof(e));
+			if (!fake_pct_trace)
+				abort();
+		}
+		fake_pct_trace[fake_pct_trace_nr++] = e;
+	}
+	fclose(f);
+	fake_pct_replaying = true;
+}
+
+static void fake_pct_init(void)
+{
+	const char *seed = getenv("PCT_SEED");
+	const char *path;
+	int i;
+
+	fake_pct_seed = seed ? strtoull(seed, NULL, 0) : 1;
+	fake_pct_state = fake_pct_seed * 0x9E3779B97F4A7C15ULL;
+	if (!fake_pct_state)
+		fake_pct_state = 1;
+	for (i = 0; i < PCT_DEPTH - 1; i++)
+		fake_pct_change[i] = 1 + fake_random(&fake_pct_state) %
+					 PCT_STEPS;
+	qsort(fake_pct_change, PCT_DEPTH - 1, sizeof(fake_pct_change[0]),
+	      fake_pct_change_cmp);
+	fake_pct_host_prio = PCT_DEPTH + (fake_random(&fake_pct_state) >> 1);
+	path = getenv("PCT_REPLAY");
+	if (path)
+		fake_pct_load(path);
+	path = getenv("PCT_RECORD");
+	if (path) {
+		fake_pct_record = fopen(path, "w");
+		if (!fake_pct_record) {
+			perror(path);
+			abort();
+		}
+		/* Line buffered, so that the trace of a failed run is whole */
+		setvbuf(fake_pct_record, NULL, _IOLBF, 0);
+		fprintf(fake_pct_record, "# PCT seed %llu depth %d steps %d\n",
+			fake_pct_seed, PCT_DEPTH, PCT_STEPS);
+	}
+}
+
+/* A random initial priority, above those of the change points */
+u64 fake_pct_prio(void)
+{
+	pthread_once(&fake_pct_once, fake_pct_init);
+	return PCT_DEPTH + (fake_random(&fake_pct_state) >> 1);
+}
+
+/*
+ * While a trace is replayed, the thread that it runs at the next decision,
+ * and the virtual time then: the ones of the previous decision, unless
+ * the next line of the trace is about it.
+ */
+static bool fake_pct_replay_next(unsigned int *id, u64 *now)
+{
+	struct fake_pct_event *e = &fake_pct_last;
+
+	if (!fake_pct_replaying)
+		return false;
+	if (fake_pct_trace_pos < fake_pct_trace_nr &&
+	    fake_pct_trace[fake_pct_trace_pos].nr == fake_pct_nr_decisions + 1)
+		e = &fake_pct_trace[fake_pct_trace_pos];
+	*id = e->id;
+	*now = e->now;
+	return true;
+}
+
+/* The run cannot follow the trace any further: go on under the priorities */
+static void fake_pct_replay_diverged(void)
+{
+	if (fake_pct_trace_pos < fake_pct_trace_nr)
+		printf("PCT replay diverged at decision %lu\n",
+		       fake_pct_nr_decisions + 1);
+	fake_pct_replaying = false;
+}
+
+/* The decision that f (NULL for the main thread) runs from now on */
+static void fake_pct_switch(struct fake_fiber *f)
+{
+	unsigned int id;
+	u64 now;
+
+	if (fake_pct_replay_next(&id, &now)) {
+		if (id != fake_pct_id(f)) {
+			fake_pct_replay_diverged();
+		} else {
+			if (fake_pct_trace_pos < fake_pct_trace_nr &&
+			    fake_pct_trace[fake_pct_trace_pos].nr ==
+			    fake_pct_nr_decisions + 1)
+				fake_pct_trace_pos++;
+			fake_pct_nr_replayed++;
+		}
+	}
+	fake_pct_nr_decisions++;
+	if (fake_pct_id(f) == fake_pct_last.id &&
+	    fake_sim_now == fake_pct_last.now)
+		return;
+	fake_pct_last.nr = fake_pct_nr_decisions;
+	fake_pct_last.id = fake_pct_id(f);
+	fake_pct_last.now = fake_sim_now;
+	if (fake_pct_record)
+		fprintf(fake_pct_record, "%lu %u %llu\n", fake_pct_last.nr,
+			fake_pct_last.id, fake_pct_last.now);
+}
+
+/*
+ * A preemption point: apply the change point, if this is one, and let a
+ * thread of higher priority run, if there is one. Until the first fiber
+ * is created, the main thread runs alone.
+ */
+void fake_pct_point(void)
+{
+	struct fake_fiber *f = fake_fiber_current;
+	u64 *prio = f ? &f->prio : &fake_pct_host_prio;
+
+	if (!fake_fiber_workers)
+		return;
+	pthread_once(&fake_pct_once, fake_pct_init);
+	fake_pct_nr_points++;
+	while (fake_pct_next_change < PCT_DEPTH - 1 &&
+	       fake_pct_change[fake_pct_next_change] <= fake_pct_nr_points) {
+		*prio = PCT_DEPTH - 1 - fake_pct_next_change++;
+		fake_pct_skip_until = fake_clock_ns() +
+				      PCT_DELAY_JIFFIES * (1000000000ULL / HZ);
+	}
+	if (!fake_fiber_preempted(*prio)) {
+		fake_pct_switch(f);
+		return;
+	}
+	fake_pct_nr_preempted++;
+	if (f) {
+		fake_fiber_park(f, FIBER_YIELD);
+		return;
+	}
+	do
+		fake_fiber_step(ULLONG_MAX);
+	while (fake_fiber_preempted(fake_pct_host_prio));
+	fake_pct_switch(NULL);
+}
+
+/*
+ * Print the seed and parameters of the schedule, how many preemption
+ * points the run went through, how many of them preempted, and how many
+ * decisions were made, and replayed.
+ */
+void fake_dump_pct_stats(void)
+{
+	printf("PCT seed %llu depth %d steps %d: points %lu preempted %lu\n",
+	       fake_pct_seed, PCT_DEPTH, PCT_STEPS, fake_pct_nr_points,
+	       fake_pct_nr_preempted);
+	printf("decisions %lu replayed %lu\n", fake_pct_nr_decisions,
+	       fake_pct_nr_replayed);
+}
+
+#endif /* __FAKE_PCT_H */
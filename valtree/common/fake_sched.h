@@ -0,0 +1,1092 @@
+/*
+ * "Fake" definitions to scaffold a Linux-kernel SMP environment.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ *
+ * Author: Michalis Kokologiannakis <mixaskok@gmail.com>
+ */
+
+#ifndef __FAKE_SCHED_H
+#define __FAKE_SCHED_H
+
+#ifndef __FAKE_DEFS_H
+#include "fake_defs.h"
+#endif
+
+/* 
+ * Each thread has to run on a specific CPU. In order to achieve this,
+ * we have a thread-local variable __running_cpu, which must be set
+ * accordingly, when it enters the function it's designated to execute.
+ */
+int __thread __running_cpu;
+
+/* 
+ * get_cpu - returns the CPU on which a thread runs. 
+ *
+ * Note that this function could not be a macro, because it needs to 
+ * be visible to files included before this one.
+ */
+int get_cpu(void)
+{
+	return __running_cpu;
+}
+
+/* 
+ * set_cpu - sets the CPU on which a thread will run.
+ *
+ * It is preferrable that __running_cpu variable is not modified
+ * directly, but only via get_cpu and set_cpu functions. This function
+ * should be called when a thread starts running, before acquiring the
+ * CPU's lock.
+ */
+void set_cpu(int cpu)
+{
+	__running_cpu = cpu;
+}
+
+/*
+ * Definitions to emulate CPU, interrupts, and scheduling.
+ *
+ * There is a cpu_lock for each cpu, when held, the corresponding thread
+ *      is running. Array length is equal to nr_cpu_ids.
+ * An irq_lock indicates that the corresponding thread has interrupts
+ *	masked, perhaps due to being in an interrupt handler.  Acquire
+ *	cpu_lock first, then irq_lock. You cannot disable interrupts
+ *	unless you are running, after all!
+ *	Natively, irq_mask[] (see below) takes the place of irq_lock.
+ * An nmi_lock indicates that the corresponding thread is in an NMI
+ *	handler.  You cannot acquire either cpu_lock or irq_lock while
+ *	holding nmi_lock.
+ */
+
+pthread_mutex_t cpu_lock[nr_cpu_ids] = { [0 ... nr_cpu_ids-1] = PTHREAD_MUTEX_INITIALIZER };
+#ifndef NATIVE
+pthread_mutex_t irq_lock[nr_cpu_ids] = { [0 ... nr_cpu_ids-1] = PTHREAD_MUTEX_INITIALIZER };
+#endif
+pthread_mutex_t nmi_lock[nr_cpu_ids] = { [0 ... nr_cpu_ids-1] = PTHREAD_MUTEX_INITIALIZER };
+
+#if defined(PARTITIONS) && !defined(NATIVE)
+/*
+ * With -DPARTITIONS=n -DPARTITION=k, the model checker only explores the
+ * k-th of n parts of the executions, so that the parts can be explored in
+ * parallel (see driver.sh). The executions are split by the order in which
+ * threads get hold of each CPU in fake_acquire_cpu() and take interrupts
+ * on it in do_IRQ(): each of these is a stream of choices, whose first
+ * PARTITION_DEPTH choices are hashed. The prime factors of n are dealt out
+ * in turn to the streams of the first PARTITION_CPUS CPUs, CPU 0 first, so
+ * that each stream s gets a radix m_s, with n the product of them all, and
+ * k is written as the digits of that mixed radix. The thread that makes
+ * the last hashed choice of a stream lets the execution go on only if the
+ * hash modulo m_s is the digit of s. An execution that makes fewer choices
+ * in some stream is explored in each part that differs from its own only
+ * in the digit of that stream. Only CPU 0 is used by default: in litmus.c,
+ * the updater and the grace-period kthread share it, while the reader has
+ * CPU 1 to itself.
+ *
+ * A choice is hashed as whether it is made by a kthread, by how many
+ * choices of that kind its thread made before, and by whether the same
+ * thread made the choice before it in the stream. This does not depend on
+ * the model checker's thread ids. The state of a stream is only accessed
+ * with the lock that orders its choices held, cpu_lock[] or irq_lock[] of
+ * the CPU, and is no longer written once its choices are made, so that it
+ * adds nothing for the model checker to explore.
+ */
+#ifndef PARTITION
+# define PARTITION 0
+#endif
+#ifndef PARTITION_DEPTH
+# define PARTITION_DEPTH 4
+#endif
+#ifndef PARTITION_CPUS
+# define PARTITION_CPUS 1
+#endif
+
+#define FAKE_PARTITION_CPU 0
+#define FAKE_PARTITION_IRQ 1
+#define FAKE_PARTITION_STREAMS (2 * PARTITION_CPUS)
+
+static int fake_partition_nr[FAKE_PARTITION_STREAMS];
+static unsigned int fake_partition_hash[FAKE_PARTITION_STREAMS];
+static __thread unsigned int fake_partition_made[2];
+/* One past the number of the last choice the thread made in a stream */
+static __thread int fake_partition_last[FAKE_PARTITION_STREAMS];
+
+/* The radix of stream s, and the product of those of the streams before */
+static unsigned int fake_partition_radix(int s, unsigned int *below)
+{
+	unsigned int n = PARTITIONS, p = 2, m = 1;
+	int i = 0;
+
+	*below = 1;
+	while (n > 1) {
+		if (n % p) {
+			p++;
+			continue;
+		}
+		n /= p;
+		if (i % FAKE_PARTITION_STREAMS == s)
+			m *= p;
+		else if (i % FAKE_PARTITION_STREAMS < s)
+			*below *= p;
+		i++;
+	}
+	return m;
+}
+
+/* A choice of the given kind on cpu, with the lock that orders it held */
+static void fake_partition_choice(int cpu, int kind)
+{
+	int s = 2 * cpu + kind;
+	unsigned int made = fake_partition_made[kind]++;
+	unsigned int m, below, choice;
+
+	if (cpu >= PARTITION_CPUS || fake_partition_nr[s] >= PARTITION_DEPTH)
+		return;
+	choice = (2 * made + !!current) * 2 +
+		 (fake_partition_last[s] == fake_partition_nr[s]);
+	fake_partition_hash[s] = fake_partition_hash[s] * 31 + choice;
+	fake_partition_last[s] = ++fake_partition_nr[s];
+	if (fake_partition_nr[s] < PARTITION_DEPTH)
+		return;
+	m = fake_partition_radix(s, &below);
+	if (m > 1)
+		__VERIFIER_assume(fake_partition_hash[s] % m ==
+				  PARTITION / below % m);
+}
+#else
+# define fake_partition_choice(cpu, kind) do { } while (0)
+#endif
+
+/*
+ * Acquire the lock of the specified CPU. It is assumed that the CPU
+ * of which the lock we are trying to acquire is idle, therefore
+ * RCU is told that the CPU leaves its idle state.
+ */
+#ifdef NATIVE
+/* Interrupt handlers between irq_enter() and irq_exit() on each CPU */
+unsigned int fake_irqs_in_flight[NR_CPUS];
+
+/*
+ * Natively, each CPU has a runqueue of sorts: fake_nr_running[cpu] counts
+ * the threads that hold or wait for its cpu_lock, and fake_cpu_curr[cpu]
+ * is the task that holds it (the idle task, or NULL, if none does), which
+ * interrupt handlers see as current. As in the kernel's scheduler_tick(),
+ * each tick sets need_resched on a CPU that has another task waiting for
+ * it, and so do resched_cpu() and friends. The flag is cleared whenever a
+ * task gets hold of the CPU.
+ */
+unsigned int fake_nr_running[NR_CPUS];
+struct task_struct *fake_cpu_curr[NR_CPUS];
+unsigned int fake_need_resched[NR_CPUS];
+unsigned long fake_resched_ticks[NR_CPUS];
+
+/* The task of a thread that is neither a kthread nor a fiber's */
+static __thread struct task_struct fake_thread_task;
+
+bool need_resched(void)
+{
+	return __atomic_load_n(&fake_need_resched[get_cpu()],
+			       __ATOMIC_RELAXED);
+}
+
+/*
+ * In the kernel, a CPU enters or leaves idle only when it is not running
+ * an interrupt handler. Natively, interrupts are handled by other threads,
+ * so wait until no handler is in flight on cpu, and keep new ones out
+ * while RCU is told about the transition, which the CPU's idle task makes.
+ */
+static void fake_rcu_idle_switch(int cpu, int enter)
+{
+	struct task_struct *prev = current;
+	unsigned long flags;
+
+	for (;;) {
+		local_irq_save(flags);
+		if (!__atomic_load_n(&fake_irqs_in_flight[cpu], __ATOMIC_ACQUIRE))
+			break;
+		local_irq_restore(flags);
+		sched_yield();
+	}
+	current = idle_task(cpu);
+	if (enter) {
+		fake_rcu_idle_enter();
+		WRITE_ONCE(fake_cpu_curr[cpu], current);
+	} else {
+		fake_rcu_idle_exit();
+		WRITE_ONCE(fake_cpu_curr[cpu], prev);
+		__atomic_store_n(&fake_need_resched[cpu], 0, __ATOMIC_RELAXED);
+	}
+	current = prev;
+	local_irq_restore(flags);
+}
+
+/*
+ * Natively, kthreads first move to the CPU they are bound to, and a task
+ * that finds its CPU offline moves to the next online one. Tasks are not
+ * moved back once the CPU comes back online.
+ */
+void fake_acquire_cpu(int cpu)
+{
+#ifdef PCT
+	fake_pct_point();
+#endif
+	cpu = fake_kthread_migrate(cpu);
+	for (;;) {
+		__atomic_add_fetch(&fake_nr_running[cpu], 1, __ATOMIC_RELAXED);
+		if (pthread_mutex_lock(&cpu_lock[cpu]))
+			exit(-1);
+		if (likely(cpu_online(cpu)))
+			break;
+		if (pthread_mutex_unlock(&cpu_lock[cpu]))
+			exit(-1);
+		__atomic_sub_fetch(&fake_nr_running[cpu], 1, __ATOMIC_RELAXED);
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_next(-1, cpu_online_mask);
+		set_cpu(cpu);
+	}
+	fake_pin_cpu(cpu);
+#ifdef FIBERS
+	/* Fibers share the TLS of their host thread, but not its task */
+	if (!current)
+		current = fake_fiber_task();
+#endif
+	if (!current) {
+		fake_thread_task.pid = syscall(SYS_gettid);
+		strcpy(fake_thread_task.comm, "task");
+		current = &fake_thread_task;
+	}
+	fake_rcu_idle_switch(cpu, 0);
+	fake_kthread_account(1);
+}
+#else /* #ifdef NATIVE */
+void fake_acquire_cpu(int cpu)
+{
+	if (pthread_mutex_lock(&cpu_lock[cpu]))
+		exit(-1);
+	fake_partition_choice(cpu, FAKE_PARTITION_CPU);
+	fake_rcu_idle_exit();
+}
+#endif /* #ifdef NATIVE */
+
+/*
+ * Release the lock of the specified CPU. It is assumed that this CPU
+ * will now be idle. If another process wants the lock of the CPU it
+ * must obtain it using fake_acquire_cpu.
+ */
+void fake_release_cpu(int cpu)
+{
+#ifdef NATIVE
+	fake_kthread_account(0);
+	fake_rcu_idle_switch(cpu, 1);
+#else
+	fake_rcu_idle_enter();
+#endif
+	if (pthread_mutex_unlock(&cpu_lock[cpu]))
+		exit(-1);
+#ifdef NATIVE
+	__atomic_sub_fetch(&fake_nr_running[cpu], 1, __ATOMIC_RELAXED);
+#endif
+}
+
+/*
+ * Fake cond_resched by having the thread running on the CPU drop
+ * the CPU lock and then try to acquire the lock of the same CPU. 
+ * Before dropping the lock rcu_note_context_switch is called, since,
+ * in theory, the __schedule function would have called it.
+ */
+int cond_resched(void)
+{
+	fake_rcu_note_context_switch();
+	fake_release_cpu(get_cpu());	
+#if defined(FIBERS) && !defined(PCT)
+	/*
+	 * Let the other fibers of this host thread run. Under PCT, the
+	 * priorities decide that in fake_acquire_cpu(), and a yield would
+	 * be taken for spinning, which lets preempted threads run.
+	 */
+	sched_yield();
+#endif
+	fake_acquire_cpu(get_cpu());
+
+	return 0;
+}
+
+#ifdef NATIVE
+void resched_cpu(int cpu)
+{
+	__atomic_store_n(&fake_need_resched[cpu], 1, __ATOMIC_RELAXED);
+}
+
+void smp_send_reschedule(int cpu)
+{
+	resched_cpu(cpu);
+}
+
+void set_need_resched(void)
+{
+	resched_cpu(get_cpu());
+}
+
+/* Called on every tick, after RCU has been told about it */
+static void fake_scheduler_tick(void)
+{
+	int cpu = get_cpu();
+
+	if (__atomic_load_n(&fake_nr_running[cpu], __ATOMIC_RELAXED) > 1 &&
+	    !__atomic_exchange_n(&fake_need_resched[cpu], 1, __ATOMIC_RELAXED))
+		fake_resched_ticks[cpu]++;
+}
+#else /* #ifdef NATIVE */
+void resched_cpu(int cpu)
+{
+	/* Unimplemented */
+}
+
+void smp_send_reschedule(int cpu)
+{
+	/* Unimplemented */
+}
+
+void set_need_resched(void)
+{
+	/* Unimplemented */
+}
+#endif /* #ifdef NATIVE */
+
+/* 
+ * Functions that emulate interrupt enabling/disabling.
+ *
+ * These functions acquire the irq_lock if it is not a nested interrupt,
+ * release it if we are returning to kernel space, and count the current 
+ * interrupt depth. When a thread disables/enables interrupts, it has to
+ * acquire/release the irq_lock.
+ */
+#if defined(NATIVE) || LINUX_VERSION_CODE >= KERNEL_VERSION(4, 9, 0)
+static int __thread local_irq_depth[nr_cpu_ids];
+#else
+static int local_irq_depth[nr_cpu_ids];
+#endif
+
+#ifdef NATIVE
+/*
+ * Natively, interrupts are masked without a mutex: irq_mask[cpu] holds the
+ * host thread ID of the thread that has interrupts disabled on cpu (if
+ * any), shifted by IRQ_OWNER_SHIFT, along with two flags. Disabling
+ * interrupts takes a single compare-and-swap, and enabling them a single
+ * atomic AND, unless the flags are set:
+ *
+ *  - IRQ_WAITERS: another thread wants to disable interrupts on cpu, and
+ *    sleeps until they are enabled again (this is rare, since all threads
+ *    that do so but the IRQ thread hold cpu_lock).
+ *  - IRQ_TICK_PENDING: a tick arrived while interrupts were disabled. As
+ *    on real hardware, it is not lost but delivered when the owner enables
+ *    interrupts, by running do_IRQ() right there. A tick that arrives while
+ *    one is already pending is merged with it, and a tick that becomes
+ *    pending during an interrupt handler is left to the next owner.
+ *
+ * Likewise, IPIs sent while interrupts are disabled stay queued (see
+ * fake_run_ipis()) until interrupts are enabled. The owner is also the
+ * thread that NMIs of the CPU have to interrupt (see fake_nmi.h).
+ */
+#define IRQ_WAITERS		0x1
+#define IRQ_TICK_PENDING	0x2
+#define IRQ_OWNER_SHIFT		2
+
+unsigned int irq_mask[NR_CPUS];
+unsigned long fake_deferred_ticks[NR_CPUS];
+static __thread pid_t fake_tid;
+
+/* Hardirq nesting of the current thread */
+static int __thread fake_hardirq_count;
+/* The current thread's own task, while it runs an interrupt handler */
+static struct task_struct __thread *fake_irq_task;
+
+void do_IRQ(void);
+
+static inline pid_t fake_gettid(void)
+{
+	if (unlikely(!fake_tid))
+		fake_tid = syscall(SYS_gettid);
+	return fake_tid;
+}
+
+/* Host thread ID of the thread that has interrupts disabled on cpu */
+static inline pid_t fake_irq_owner(int cpu)
+{
+	return __atomic_load_n(&irq_mask[cpu], __ATOMIC_SEQ_CST) >>
+	       IRQ_OWNER_SHIFT;
+}
+
+/* Disable interrupts on cpu if nobody else has, without blocking */
+static inline bool fake_irq_trylock(int cpu)
+{
+	unsigned int old = __atomic_load_n(&irq_mask[cpu], __ATOMIC_RELAXED);
+
+	do {
+		if (old >> IRQ_OWNER_SHIFT)
+			return false;
+	} while (!__atomic_compare_exchange_n(&irq_mask[cpu], &old,
+			old | fake_gettid() << IRQ_OWNER_SHIFT, false,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	return true;
+}
+
+static void fake_irq_lock_slow(int cpu)
+{
+	unsigned int old;
+
+	while (!fake_irq_trylock(cpu)) {
+		old = __atomic_load_n(&irq_mask[cpu], __ATOMIC_RELAXED);
+		if (!(old >> IRQ_OWNER_SHIFT) ||
+		    (!(old & IRQ_WAITERS) &&
+		     !__atomic_compare_exchange_n(&irq_mask[cpu], &old,
+						  old | IRQ_WAITERS, false,
+						  __ATOMIC_RELAXED,
+						  __ATOMIC_RELAXED)))
+			continue;
+		fake_futex_wait(&irq_mask[cpu], old | IRQ_WAITERS);
+	}
+}
+
+static inline void fake_irq_lock(int cpu)
+{
+	unsigned int old = 0;
+
+	if (unlikely(!__atomic_compare_exchange_n(&irq_mask[cpu], &old,
+			fake_gettid() << IRQ_OWNER_SHIFT, false,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)))
+		fake_irq_lock_slow(cpu);
+}
+
+static void fake_irq_unlock_slow(int cpu, unsigned int old)
+{
+	if (old & IRQ_WAITERS)
+		fake_futex_wake(&irq_mask[cpu], INT_MAX);
+	if (old & IRQ_TICK_PENDING)
+		do_IRQ();
+}
+
+/*
+ * Enable interrupts on cpu, taking the tick and the IPIs that arrived in
+ * the meantime, unless we are in an interrupt handler already.
+ */
+static inline void fake_irq_unlock(int cpu)
+{
+	unsigned int keep = fake_hardirq_count ? IRQ_TICK_PENDING : 0;
+	unsigned int old;
+
+	old = __atomic_fetch_and(&irq_mask[cpu], keep, __ATOMIC_RELEASE);
+	if (unlikely(old & (IRQ_WAITERS | IRQ_TICK_PENDING)))
+		fake_irq_unlock_slow(cpu, old & ~keep);
+	fake_ipi_check();
+}
+
+/*
+ * Disable interrupts on cpu to take a tick, unless somebody else has
+ * disabled them, in which case the tick is left pending. Returns true if
+ * the tick has to be taken now.
+ */
+static bool fake_irq_trylock_or_defer(int cpu)
+{
+	unsigned int old = __atomic_load_n(&irq_mask[cpu], __ATOMIC_RELAXED);
+	unsigned int new;
+
+	do {
+		if (old >> IRQ_OWNER_SHIFT) {
+			if (old & IRQ_TICK_PENDING)
+				return false;
+			new = old | IRQ_TICK_PENDING;
+		} else {
+			new = (old & ~IRQ_TICK_PENDING) |
+			      fake_gettid() << IRQ_OWNER_SHIFT;
+		}
+	} while (!__atomic_compare_exchange_n(&irq_mask[cpu], &old, new, false,
+					      __ATOMIC_ACQUIRE,
+					      __ATOMIC_RELAXED));
+	if (new & IRQ_TICK_PENDING) {
+		fake_deferred_ticks[cpu]++;
+		return false;
+	}
+	return true;
+}
+
+void fake_local_irq_save(void)
+{
+	if (!local_irq_depth[get_cpu()]++)
+		fake_irq_lock(get_cpu());
+}
+
+void local_irq_restore(unsigned long flags)
+{
+	if (!--local_irq_depth[get_cpu()])
+		fake_irq_unlock(get_cpu());
+}
+
+void local_irq_disable(void)
+{
+	if (!local_irq_depth[get_cpu()])
+		fake_irq_lock(get_cpu());
+	local_irq_depth[get_cpu()] = 1;
+}
+
+void local_irq_enable(void)
+{
+	local_irq_depth[get_cpu()] = 0;
+	fake_irq_unlock(get_cpu());
+}
+#else /* #ifdef NATIVE */
+void local_irq_save(unsigned long flags)
+{
+	if (!local_irq_depth[get_cpu()]++) {
+		if (pthread_mutex_lock(&irq_lock[get_cpu()]))
+			exit(-1);
+	}	
+}
+
+void local_irq_restore(unsigned long flags)
+{
+	if (!--local_irq_depth[get_cpu()]) {
+		if (pthread_mutex_unlock(&irq_lock[get_cpu()]))
+			exit(-1);
+	}	
+}
+
+void local_irq_disable(void)
+{
+	if (!local_irq_depth[get_cpu()]) {
+		if (pthread_mutex_lock(&irq_lock[get_cpu()]))
+			exit(-1);
+	}
+	local_irq_depth[get_cpu()] = 1;
+}
+
+void local_irq_enable(void)
+{
+	local_irq_depth[get_cpu()] = 0;
+	if (pthread_mutex_unlock(&irq_lock[get_cpu()]))
+		exit(-1);
+}
+
+#endif /* #ifdef NATIVE */
+
+int irqs_disabled_flags(unsigned long flags)
+{
+	return !!local_irq_depth[get_cpu()];
+}
+
+int in_interrupt(void)
+{
+	return !!local_irq_depth[get_cpu()];
+}
+
+#ifdef NATIVE
+void fake_invoke_softirq(void);
+bool fake_softirq_pending(void);
+
+/*
+ * Inform RCU that we are entering an interrupt handler.
+ */
+void irq_enter(void)
+{
+	__atomic_add_fetch(&fake_irqs_in_flight[get_cpu()], 1, __ATOMIC_RELAXED);
+	if (!fake_hardirq_count) {
+		fake_irq_task = current;
+		current = READ_ONCE(fake_cpu_curr[get_cpu()]);
+	}
+	rcu_irq_enter();
+	fake_hardirq_count++;
+}
+
+/*
+ * As in the kernel, softirqs raised on this CPU are handled on the way
+ * out of the outermost interrupt handler, or deferred to ksoftirqd (see
+ * fake_softirq.h). Inform RCU that we are exiting an interrupt handler.
+ */
+void irq_exit(void)
+{
+	if (!--fake_hardirq_count && fake_softirq_pending())
+		fake_invoke_softirq();
+	rcu_irq_exit();
+	if (!fake_hardirq_count)
+		current = fake_irq_task;
+	__atomic_sub_fetch(&fake_irqs_in_flight[get_cpu()], 1, __ATOMIC_RELEASE);
+}
+#else /* #ifdef NATIVE */
+/*
+ * Inform RCU that we are entering an interrupt handler.
+ */
+void irq_enter(void)
+{
+	rcu_irq_enter();
+}
+
+/*
+ * If this CPU has pending callbacks, execute __do_softirq(). Since we only
+ * care about RCU callbacks, just rcu_process_callbacks() is called.
+ * Inform RCU that we are exiting an interrupt handler.
+ */
+void irq_exit(void)
+{
+	if (need_softirq[get_cpu()]) {
+		rcu_process_callbacks(NULL);
+		need_softirq[get_cpu()] = 0;
+	}
+	rcu_irq_exit();
+}
+#endif /* #ifdef NATIVE */
+
+/*
+ * Main interrupt function. This function is designed to emulate timer
+ * interrupts, however, I/O interrupts closely resemble timer interrupts.
+ * This function assumes that the interrupt occured while in kernel space.
+ * The irq_lock is held during the execution of the interrupt handler,
+ * but it is released when softirqs are serviced.
+ */
+void do_IRQ(void)
+{
+#ifdef NATIVE
+	/* Taken once interrupts are enabled, if they are disabled now */
+	if (!fake_irq_trylock_or_defer(get_cpu()))
+		return;
+	local_irq_depth[get_cpu()] = 1;
+#else
+	local_irq_disable();
+	fake_partition_choice(get_cpu(), FAKE_PARTITION_IRQ);
+#endif
+#ifdef NATIVE
+	/* The CPU may have gone offline since the interrupt was raised */
+	if (unlikely(cpu_is_offline(get_cpu()))) {
+		local_irq_enable();
+		return;
+	}
+#endif
+	irq_enter();
+
+#ifdef NATIVE
+	fake_run_ipis();
+#endif
+	fake_rcu_check_callbacks(0);
+#ifdef NATIVE
+	fake_scheduler_tick();
+#endif
+	
+	local_irq_enable();
+	irq_exit();
+}
+
+#ifdef NATIVE
+/*
+ * Cross-CPU function calls (IPIs).
+ *
+ * Each CPU has a queue of pending calls. A call is pushed onto the queue
+ * of its target CPU, and is handled in interrupt context on that CPU the
+ * next time it either takes an interrupt (do_IRQ()) or re-enables
+ * interrupts. When IRQ threads are used, the sender also kicks the IRQ
+ * thread of the target CPU, so that the call is handled right away
+ * instead of at the next tick.
+ */
+struct fake_call_single_data {
+	struct fake_call_single_data *next;
+	smp_call_func_t func;
+	void *info;
+	int wait;
+	unsigned int done;	/* Set once func has run, if wait is set */
+	u64 queued;		/* Time at which the call was sent */
+};
+
+struct fake_ipi_stats {
+	unsigned long sent;	/* IPIs sent by this CPU */
+	u64 send_ns;		/* Time spent sending them */
+	unsigned long received;	/* IPIs handled by this CPU */
+	u64 latency_ns;		/* Total time from sending to handling */
+	u64 max_latency_ns;
+	u64 handler_ns;		/* Time spent in the handlers */
+} ____cacheline_aligned_in_smp;
+
+struct fake_call_single_data *ipi_queue[NR_CPUS];
+unsigned int irq_kick[NR_CPUS];
+struct fake_ipi_stats fake_ipi_stats[NR_CPUS];
+static int __thread fake_in_ipi;
+
+/*
+ * Run the calls pending on the current CPU, in the order in which they
+ * were sent. Must be called from interrupt context.
+ */
+void fake_run_ipis(void)
+{
+	struct fake_ipi_stats *st = &fake_ipi_stats[get_cpu()];
+	struct fake_call_single_data *csd, *next, *list = NULL;
+	u64 start, lat;
+
+	csd = __atomic_exchange_n(&ipi_queue[get_cpu()], NULL,
+				  __ATOMIC_ACQUIRE);
+	while (csd) {
+		next = csd->next;
+		csd->next = list;
+		list = csd;
+		csd = next;
+	}
+	for (csd = list; csd; csd = next) {
+		next = csd->next;
+		start = fake_clock_ns();
+		lat = start - csd->queued;
+		st->received++;
+		st->latency_ns += lat;
+		if (lat > st->max_latency_ns)
+			st->max_latency_ns = lat;
+		csd->func(csd->info);
+		st->handler_ns += fake_clock_ns() - start;
+		if (csd->wait) {
+			/* The sender's csd goes away as soon as it sees done */
+			__atomic_store_n(&csd->done, 1, __ATOMIC_RELEASE);
+			fake_futex_wake(&csd->done, 1);
+		} else {
+			free(csd);
+		}
+	}
+}
+
+/*
+ * Take an IPI on the current CPU. The IPI handler does not re-enter
+ * itself when it re-enables interrupts. If another thread has interrupts
+ * disabled on the CPU, the IPI is left queued, and that thread takes it
+ * when it enables them.
+ */
+void fake_ipi_interrupt(void)
+{
+	if (!fake_irq_trylock(get_cpu()))
+		return;
+	fake_in_ipi = 1;
+	local_irq_depth[get_cpu()] = 1;
+	irq_enter();
+	fake_run_ipis();
+	local_irq_enable();
+	irq_exit();
+	fake_in_ipi = 0;
+}
+
+/* Called whenever interrupts get re-enabled on the current CPU */
+void fake_ipi_check(void)
+{
+	if (unlikely(__atomic_load_n(&ipi_queue[get_cpu()], __ATOMIC_RELAXED)) &&
+	    !fake_in_ipi)
+		fake_ipi_interrupt();
+}
+
+/*
+ * Run func(info) on the specified CPU. If wait is set, wait until func
+ * has completed. As in the kernel, a call to the current CPU is made
+ * directly, with interrupts disabled.
+ */
+int smp_call_function_single(int cpu, smp_call_func_t func, void *info,
+			     int wait)
+{
+	struct fake_ipi_stats *st = &fake_ipi_stats[get_cpu()];
+	struct fake_call_single_data csd_stack, *csd = &csd_stack;
+	unsigned long flags;
+	u64 start;
+
+	if (cpu < 0 || cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return -ENXIO;
+	if (cpu == get_cpu()) {
+		local_irq_save(flags);
+		func(info);
+		local_irq_restore(flags);
+		return 0;
+	}
+
+	start = fake_clock_ns();
+	if (!wait)
+		csd = malloc(sizeof(*csd));
+	csd->func = func;
+	csd->info = info;
+	csd->wait = wait;
+	csd->done = 0;
+	csd->queued = start;
+	csd->next = __atomic_load_n(&ipi_queue[cpu], __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&ipi_queue[cpu], &csd->next, csd,
+					    true, __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED))
+		;
+	fake_wake_up(&irq_kick[cpu], 1);
+	__atomic_fetch_add(&st->sent, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&st->send_ns, fake_clock_ns() - start,
+			   __ATOMIC_RELAXED);
+
+	if (wait) {
+		while (!__atomic_load_n(&csd->done, __ATOMIC_ACQUIRE))
+			fake_futex_wait(&csd->done, 0);
+	}
+	return 0;
+}
+
+/*
+ * CPU stoppers run in a high-priority task in the kernel. Here, they
+ * are run as IPIs. try_stop_cpus() runs fn on the CPUs one by one, rather
+ * than on all of them at once, and never fails with -EAGAIN, since
+ * concurrent callers are serialized.
+ */
+static void fake_cpu_stop_func(void *info)
+{
+	struct cpu_stop_work *work = info;
+
+	work->fn(work->arg);
+}
+
+bool stop_one_cpu_nowait(unsigned int cpu, cpu_stop_fn_t fn, void *arg,
+			 struct cpu_stop_work *work_buf)
+{
+	work_buf->fn = fn;
+	work_buf->arg = arg;
+	work_buf->done = NULL;
+	return !smp_call_function_single(cpu, fake_cpu_stop_func, work_buf, 0);
+}
+
+struct fake_stop_cpus {
+	cpu_stop_fn_t fn;
+	void *arg;
+	int ret;
+};
+
+static void fake_stop_cpus_func(void *info)
+{
+	struct fake_stop_cpus *sc = info;
+	int ret = sc->fn(sc->arg);
+
+	if (ret)
+		__atomic_store_n(&sc->ret, ret, __ATOMIC_RELAXED);
+}
+
+int try_stop_cpus(cpumask_var_t cpumask, cpu_stop_fn_t fn, void *arg)
+{
+	static pthread_mutex_t stop_cpus_mutex = PTHREAD_MUTEX_INITIALIZER;
+	struct fake_stop_cpus sc = { .fn = fn, .arg = arg };
+	int cpu;
+
+	if (pthread_mutex_lock(&stop_cpus_mutex))
+		exit(-1);
+	for_each_cpu(cpu, cpumask)
+		smp_call_function_single(cpu, fake_stop_cpus_func, &sc, 1);
+	if (pthread_mutex_unlock(&stop_cpus_mutex))
+		exit(-1);
+	return sc.ret;
+}
+
+/*
+ * Print the IPI traffic of each CPU: how many IPIs it sent and the
+ * average cost of sending one, and how many it handled along with the
+ * average/maximum delivery latency and the average handler run time.
+ */
+void fake_dump_ipi_stats(void)
+{
+	struct fake_ipi_stats *st;
+	int cpu;
+
+	printf("IPI statistics:\n");
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		st = &fake_ipi_stats[cpu];
+		printf("cpu %-4d sent %8lu (%6llu ns) recv %8lu lat %8llu/%8llu ns handler %6llu ns\n",
+		       cpu, st->sent, st->sent ? st->send_ns / st->sent : 0,
+		       st->received,
+		       st->received ? st->latency_ns / st->received : 0,
+		       st->max_latency_ns,
+		       st->received ? st->handler_ns / st->received : 0);
+	}
+}
+
+/*
+ * When running natively, the IRQ threads act as per-CPU scheduling-clock
+ * ticks: each one calls do_IRQ() HZ times per second (HZ can be set with
+ * -DCONFIG_HZ). Each tick can be shifted by up to +-TICK_JITTER_US
+ * microseconds. If a tick is handled so late that the next one is already
+ * due, the ticks in between are dropped (and counted as missed).
+ */
+#define TICK_NSEC (1000000000ULL / HZ)
+#ifndef TICK_JITTER_US
+# define TICK_JITTER_US 0
+#endif
+
+unsigned long fake_ticks[NR_CPUS];
+unsigned long fake_missed_ticks[NR_CPUS];
+
+void *irq_thread(void *cpu)
+{
+	u64 next, when, now;
+	u64 seed;
+	unsigned int kick;
+	s64 jitter = TICK_JITTER_US * 1000LL;
+
+	set_cpu(*(int *) cpu);
+	fake_pin_cpu(get_cpu());
+
+	seed = get_cpu() + 1;
+	next = fake_clock_ns();
+	for (;;) {
+		next += TICK_NSEC;
+		when = next;
+		if (jitter)
+			when += (s64) (fake_random(&seed) % (2 * jitter + 1)) -
+				jitter;
+
+		/* Sleep until the tick is due, but handle IPIs right away */
+		for (;;) {
+			kick = __atomic_load_n(&irq_kick[get_cpu()],
+					       __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&ipi_queue[get_cpu()],
+					    __ATOMIC_RELAXED) &&
+			    cpu_online(get_cpu()))
+				fake_ipi_interrupt();
+			if (fake_clock_ns() >= when)
+				break;
+			fake_futex_wait_until(&irq_kick[get_cpu()], kick,
+					      when);
+		}
+
+		/* Offline CPUs take no ticks */
+		if (cpu_online(get_cpu())) {
+			do_IRQ();
+			fake_ticks[get_cpu()]++;
+		}
+
+		now = fake_clock_ns();
+		if (now >= next + TICK_NSEC) {
+			fake_missed_ticks[get_cpu()] +=
+				(now - next) / TICK_NSEC;
+			next = now;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Print how many ticks were delivered to each CPU over the last
+ * elapsed_ns nanoseconds, how many of them were deferred until interrupts
+ * got enabled, how many of them set need_resched, and the resulting tick
+ * rate.
+ */
+void fake_dump_tick_stats(u64 elapsed_ns)
+{
+	int cpu;
+
+	printf("Tick statistics (HZ=%d, jitter %d us):\n", HZ, TICK_JITTER_US);
+	for (cpu = 0; cpu < NR_CPUS; cpu++)
+		printf("cpu %-4d ticks %8lu missed %8lu deferred %8lu resched %8lu rate %8.1f/s\n",
+		       cpu, fake_ticks[cpu], fake_missed_ticks[cpu],
+		       fake_deferred_ticks[cpu], fake_resched_ticks[cpu],
+		       elapsed_ns ? fake_ticks[cpu] * 1e9 / elapsed_ns : 0.0);
+}
+#else /* #ifdef NATIVE */
+/* 
+ * Interrupts are modeled by having a thread executing do_IRQ() repeatedly
+ * on a designated CPU, which is passed as a parameter to this function.
+ */
+void *irq_thread(void *cpu)
+{
+	set_cpu(*(int *) cpu);
+
+	for (;;)
+		do_IRQ();
+	return NULL;
+}
+#endif /* #ifdef NATIVE */
+
+static int irq_cpus[NR_CPUS];
+
+void spawn_irq_kthread(int i)
+{
+	pthread_t t;
+
+	irq_cpus[i] = i;
+	if (pthread_create(&t, NULL, irq_thread, &irq_cpus[i]))
+		abort();
+	return;
+}
+
+#ifdef NATIVE
+/*
+ * Print the statistics gathered for a single (native) spinlock.
+ */
+void fake_print_lock_stats(const char *name, struct fake_lock_stats *st)
+{
+	printf("%-24s acq %10lu cont %10lu (%5.1f%%) spin %12llu ns\n",
+	       name, st->acquired, st->contended,
+	       st->acquired ? 100.0 * st->contended / st->acquired : 0.0,
+	       st->spin_ns);
+}
+
+/*
+ * Print the lock statistics of rsp. The rcu_node locks are first
+ * aggregated per level of the tree, which shows which levels get hot,
+ * and are then listed one by one. The ->fqslock and ->exp_lock of each
+ * node are only listed if they have been used.
+ */
+void fake_dump_lock_stats(struct rcu_state *rsp)
+{
+	struct fake_lock_stats level[RCU_NUM_LVLS];
+	struct rcu_node *rnp;
+	char name[32];
+	int i;
+
+	printf("Lock statistics for %s:\n", rsp->name);
+	memset(level, 0, sizeof(level));
+	rcu_for_each_node_breadth_first(rsp, rnp) {
+		level[rnp->level].acquired += rnp->lock.stats.acquired;
+		level[rnp->level].contended += rnp->lock.stats.contended;
+		level[rnp->level].spin_ns += rnp->lock.stats.spin_ns;
+	}
+	for (i = 0; i < rcu_num_lvls; i++) {
+		sprintf(name, "level %d", i);
+		fake_print_lock_stats(name, &level[i]);
+	}
+	rcu_for_each_node_breadth_first(rsp, rnp) {
+		sprintf(name, "rnp %d:%d-%d", rnp->level, rnp->grplo,
+			rnp->grphi);
+		fake_print_lock_stats(name, &rnp->lock.stats);
+		if (rnp->fqslock.stats.acquired) {
+			strcat(name, " fqslock");
+			fake_print_lock_stats(name, &rnp->fqslock.stats);
+		}
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+		if (rnp->exp_lock.stats.acquired) {
+			sprintf(name, "rnp %d:%d-%d exp_lock", rnp->level,
+				rnp->grplo, rnp->grphi);
+			fake_print_lock_stats(name, &rnp->exp_lock.stats);
+		}
+#endif
+	}
+	fake_print_lock_stats("orphan_lock", &rsp->orphan_lock.stats);
+}
+
+#include "fake_kthread.h"
+#include "fake_hotplug.h"
+#include "fake_softirq.h"
+#include "fake_slab.h"
+#include "fake_nmi.h"
+#ifdef FIBERS
+#include "fake_fiber.h"
+#endif
+#ifdef SIMULATE
+#include "fake_sim.h"
+#endif
+#ifdef PCT
+#include "fake_pct.h"
+#endif
+#ifdef PIN_CPUS
+#include "fake_topology.h"
+#endif
+#endif /* #ifdef NATIVE */
+
+#endif /* __FAKE_SCHED_H */
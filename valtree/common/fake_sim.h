@@ -0,0 +1,165 @@
+/*
+ * Cache-line cost model for simulated native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_SIM_H
+#define __FAKE_SIM_H
+
+/*
+ * With -DSIMULATE, a native run is a deterministic discrete-event
+ * simulation in virtual time (see fake_fiber.h), in which the emulated
+ * CPUs are grouped into sockets of SIM_SOCKET_CPUS CPUs each. Atomic
+ * read-modify-write operations and lock acquisitions are charged for the
+ * cache-line transfer they cause: SIM_HIT_NS if the CPU already owns the
+ * line, i.e., was the last one to modify it, SIM_LOCAL_NS if another CPU
+ * of the same socket does, and SIM_REMOTE_NS if a CPU of another socket
+ * does (or if the line has never been modified). The CPU then owns the
+ * line. Full barriers cost SIM_MB_NS. Plain loads and stores, as well as
+ * the emulation's own atomics (e.g., on irq_mask[]), are free.
+ */
+#ifndef SIM_SOCKET_CPUS
+# define SIM_SOCKET_CPUS 32
+#endif
+#ifndef SIM_HIT_NS
+# define SIM_HIT_NS 5
+#endif
+#ifndef SIM_LOCAL_NS
+# define SIM_LOCAL_NS 40
+#endif
+#ifndef SIM_REMOTE_NS
+# define SIM_REMOTE_NS 120
+#endif
+#ifndef SIM_MB_NS
+# define SIM_MB_NS 20
+#endif
+
+/* Owner of each cache line that has been modified, by line address */
+struct fake_sim_line {
+	unsigned long line;	/* 0 if the slot is free */
+	int owner;
+};
+
+static struct fake_sim_line *fake_sim_lines;
+static unsigned long fake_sim_nr_lines;
+static unsigned long fake_sim_size;	/* Power of two */
+
+/* Statistics */
+static unsigned long fake_sim_nr_hit;
+static unsigned long fake_sim_nr_local;
+static unsigned long fake_sim_nr_remote;
+static unsigned long fake_sim_nr_mb;
+static u64 fake_sim_charged_ns;
+
+static struct fake_sim_line *fake_sim_slot(struct fake_sim_line *lines,
+					   unsigned long size,
+					   unsigned long line)
+{
+	unsigned long i = line * 0x9E3779B97F4A7C15ULL & (size - 1);
+
+	while (lines[i].line && lines[i].line != line)
+		i = (i + 1) & (size - 1);
+	return &lines[i];
+}
+
+/* Keep the table at most half full */
+static void fake_sim_grow(void)
+{
+	struct fake_sim_line *old = fake_sim_lines;
+	unsigned long i, size = fake_sim_size;
+
+	fake_sim_size = size ? 2 * size : 4096;
+	fake_sim_lines = calloc(fake_sim_size, sizeof(*fake_sim_lines));
+	if (!fake_sim_lines)
+		abort();
+	for (i = 0; i < size; i++)
+		if (old[i].line)
+			*fake_sim_slot(fake_sim_lines, fake_sim_size,
+				       old[i].line) = old[i];
+	free(old);
+}
+
+static struct fake_sim_line *fake_sim_line(unsigned long line)
+{
+	struct fake_sim_line *l;
+
+	if (2 * (fake_sim_nr_lines + 1) > fake_sim_size)
+		fake_sim_grow();
+	l = fake_sim_slot(fake_sim_lines, fake_sim_size, line);
+	if (!l->line) {
+		l->line = line;
+		l->owner = -1;
+		fake_sim_nr_lines++;
+	}
+	return l;
+}
+
+static void fake_sim_charge(u64 ns)
+{
+	fake_sim_charged_ns += ns;
+	fake_fiber_advance(ns);
+}
+
+/* Charge the current CPU for modifying the cache line of addr */
+void fake_sim_rmw(const volatile void *addr)
+{
+	struct fake_sim_line *l;
+	int cpu;
+
+#ifdef PCT
+	fake_pct_point();
+#endif
+	cpu = get_cpu();
+	/* The line address is never 0: page 0 is not mapped */
+	l = fake_sim_line((unsigned long) addr / SMP_CACHE_BYTES);
+	if (l->owner == cpu) {
+		fake_sim_nr_hit++;
+		fake_sim_charge(SIM_HIT_NS);
+	} else if (l->owner >= 0 &&
+		   l->owner / SIM_SOCKET_CPUS == cpu / SIM_SOCKET_CPUS) {
+		fake_sim_nr_local++;
+		fake_sim_charge(SIM_LOCAL_NS);
+	} else {
+		fake_sim_nr_remote++;
+		fake_sim_charge(SIM_REMOTE_NS);
+	}
+	l->owner = cpu;
+}
+
+void fake_sim_mb(void)
+{
+	fake_sim_nr_mb++;
+	fake_sim_charge(SIM_MB_NS);
+}
+
+/*
+ * Print the cost model, the virtual time reached and the host CPU time it
+ * took, and how many read-modify-write operations hit a line the CPU
+ * owned, or took one from its socket or from another socket.
+ */
+void fake_dump_sim_stats(void)
+{
+	printf("Simulation statistics (sockets of %d CPUs, hit %d local %d remote %d mb %d ns):\n",
+	       SIM_SOCKET_CPUS, SIM_HIT_NS, SIM_LOCAL_NS, SIM_REMOTE_NS,
+	       SIM_MB_NS);
+	printf("virtual time %llu ns, host CPU time %llu ns\n",
+	       fake_clock_ns(), fake_process_cpu_ns());
+	printf("rmw hit %10lu local %10lu remote %10lu mb %10lu charged %12llu ns lines %lu\n",
+	       fake_sim_nr_hit, fake_sim_nr_local, fake_sim_nr_remote,
+	       fake_sim_nr_mb, fake_sim_charged_ns, fake_sim_nr_lines);
+}
+
+#endif /* __FAKE_SIM_H */
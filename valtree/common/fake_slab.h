@@ -0,0 +1,300 @@
+/*
+ * Slab-style object allocator for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_SLAB_H
+#define __FAKE_SLAB_H
+
+/*
+ * Natively, kmalloc() and fake_kfree() (which the tests' kfree() can call)
+ * work like the kernel's slab allocator, so that callback floods that
+ * allocate and free memory do not end up measuring the host's malloc():
+ *
+ *  - Objects come in power-of-two size classes, from KMEM_MIN_SIZE up to
+ *    KMEM_MAX_SIZE bytes, carved out of KMEM_SLAB_SIZE-aligned slabs
+ *    whose header gives the class, so that freeing needs no size. Larger
+ *    objects get a slab of their own, which goes back to the host.
+ *  - Each emulated CPU caches the objects of each class in two magazines
+ *    of KMEM_MAG_SIZE objects (as in Bonwick's magazine layer), which it
+ *    handles with interrupts disabled, as the kernel does its per-CPU
+ *    caches.
+ *  - Once both magazines are full (or empty), one of them is traded for
+ *    an empty (or full) one from the class's depot, under the depot's
+ *    spinlock. An object freed on another CPU than the one it came from
+ *    just goes into the freeing CPU's magazines, so cross-CPU frees are
+ *    batched a magazine at a time. The depot carves new slabs when it
+ *    runs out of full magazines, and never gives memory back.
+ */
+#ifndef KMEM_MAG_SIZE
+# define KMEM_MAG_SIZE 32
+#endif
+#define KMEM_MIN_SHIFT 4
+#define KMEM_MAX_SHIFT 12
+#define KMEM_MIN_SIZE (1 << KMEM_MIN_SHIFT)
+#define KMEM_MAX_SIZE (1 << KMEM_MAX_SHIFT)
+#define KMEM_CLASSES (KMEM_MAX_SHIFT - KMEM_MIN_SHIFT + 1)
+#define KMEM_SLAB_SIZE (64 << 10)
+/* The slab header takes the first object slot, or a cache line */
+#define KMEM_SLAB_HDR 64
+
+#ifndef GFP_KERNEL
+# define GFP_KERNEL 0
+# define GFP_ATOMIC 0
+#endif
+
+struct fake_kmem_slab {
+	int class;			/* -1 for an object of its own */
+};
+
+struct fake_kmem_mag {
+	struct fake_kmem_mag *next;	/* In the depot */
+	int nr;
+	void *objs[KMEM_MAG_SIZE];
+};
+
+struct fake_kmem_depot {
+	spinlock_t lock;
+	struct fake_kmem_mag *full;
+	struct fake_kmem_mag *empty;
+	char *carve;			/* Free space of the newest slab */
+	char *carve_end;
+
+	/* Statistics */
+	unsigned long nr_slabs;
+	unsigned long nr_full;		/* Full magazines in the depot */
+} ____cacheline_aligned_in_smp;
+
+struct fake_kmem_cpu {
+	struct fake_kmem_mag *loaded[KMEM_CLASSES];
+	struct fake_kmem_mag *prev[KMEM_CLASSES];
+
+	/* Statistics */
+	unsigned long nr_alloc;
+	unsigned long nr_free;
+	unsigned long nr_depot;		/* Magazines traded with the depots */
+	unsigned long nr_large;		/* Objects beyond KMEM_MAX_SIZE */
+} ____cacheline_aligned_in_smp;
+
+struct fake_kmem_depot fake_kmem_depots[KMEM_CLASSES];
+struct fake_kmem_cpu fake_kmem_cpus[NR_CPUS];
+
+static inline int fake_kmem_class(size_t size)
+{
+	if (size <= KMEM_MIN_SIZE)
+		return 0;
+	return 64 - __builtin_clzl(size - 1) - KMEM_MIN_SHIFT;
+}
+
+static struct fake_kmem_mag *fake_kmem_new_mag(void)
+{
+	struct fake_kmem_mag *mag = malloc(sizeof(*mag));
+
+	if (!mag)
+		abort();
+	mag->nr = 0;
+	return mag;
+}
+
+/* Fill mag with new objects of the depot's class, with its lock held */
+static void fake_kmem_carve(struct fake_kmem_depot *d, int class,
+			    struct fake_kmem_mag *mag)
+{
+	size_t size = KMEM_MIN_SIZE << class;
+	struct fake_kmem_slab *slab;
+
+	while (mag->nr < KMEM_MAG_SIZE) {
+		if (d->carve + size > d->carve_end) {
+			if (posix_memalign((void **) &slab, KMEM_SLAB_SIZE,
+					   KMEM_SLAB_SIZE))
+				abort();
+			slab->class = class;
+			d->carve = (char *) slab +
+				   (size > KMEM_SLAB_HDR ? size : KMEM_SLAB_HDR);
+			d->carve_end = (char *) slab + KMEM_SLAB_SIZE;
+			d->nr_slabs++;
+		}
+		mag->objs[mag->nr++] = d->carve;
+		d->carve += size;
+	}
+}
+
+/*
+ * Trade mag, which is empty if want_full and full otherwise, for a full
+ * (or empty) magazine of the class's depot.
+ */
+static struct fake_kmem_mag *fake_kmem_trade(int class,
+					     struct fake_kmem_mag *mag,
+					     bool want_full)
+{
+	struct fake_kmem_depot *d = &fake_kmem_depots[class];
+	struct fake_kmem_mag *ret;
+
+	spin_lock(&d->lock);
+	if (want_full) {
+		mag->next = d->empty;
+		d->empty = mag;
+		ret = d->full;
+		if (ret) {
+			d->full = ret->next;
+			d->nr_full--;
+		} else {
+			ret = d->empty;
+			d->empty = ret->next;
+			fake_kmem_carve(d, class, ret);
+		}
+	} else {
+		mag->next = d->full;
+		d->full = mag;
+		d->nr_full++;
+		ret = d->empty;
+		if (ret)
+			d->empty = ret->next;
+	}
+	spin_unlock(&d->lock);
+	return ret ? ret : fake_kmem_new_mag();
+}
+
+/*
+ * Make the loaded magazine of the class non-empty (if want_full) or
+ * non-full, with interrupts disabled: swap it with the previous one if
+ * that will do, or else trade the previous one with the depot.
+ */
+static void fake_kmem_reload(struct fake_kmem_cpu *kc, int class,
+			     bool want_full)
+{
+	struct fake_kmem_mag *mag = kc->loaded[class];
+	struct fake_kmem_mag *prev = kc->prev[class];
+
+	if (!mag)
+		mag = fake_kmem_new_mag();
+	if (!prev)
+		prev = fake_kmem_new_mag();
+	if (want_full ? prev->nr : prev->nr < KMEM_MAG_SIZE) {
+		kc->loaded[class] = prev;
+	} else {
+		kc->loaded[class] = fake_kmem_trade(class, prev, want_full);
+		kc->nr_depot++;
+	}
+	kc->prev[class] = mag;
+}
+
+void *fake_kmalloc(size_t size)
+{
+	struct fake_kmem_cpu *kc;
+	struct fake_kmem_slab *slab;
+	struct fake_kmem_mag *mag;
+	unsigned long flags;
+	int class;
+	void *p;
+
+	if (size > KMEM_MAX_SIZE) {
+		if (posix_memalign((void **) &slab, KMEM_SLAB_SIZE,
+				   KMEM_SLAB_HDR + size))
+			return NULL;
+		slab->class = -1;
+		__atomic_fetch_add(&fake_kmem_cpus[get_cpu()].nr_large, 1,
+				   __ATOMIC_RELAXED);
+		return (char *) slab + KMEM_SLAB_HDR;
+	}
+	class = fake_kmem_class(size);
+	local_irq_save(flags);
+	kc = &fake_kmem_cpus[get_cpu()];
+	mag = kc->loaded[class];
+	if (unlikely(!mag || !mag->nr)) {
+		fake_kmem_reload(kc, class, true);
+		mag = kc->loaded[class];
+	}
+	p = mag->objs[--mag->nr];
+	kc->nr_alloc++;
+	local_irq_restore(flags);
+	return p;
+}
+
+void *fake_kzalloc(size_t size)
+{
+	void *p = fake_kmalloc(size);
+
+	if (p)
+		memset(p, 0, size);
+	return p;
+}
+
+void fake_kfree(const void *p)
+{
+	struct fake_kmem_slab *slab;
+	struct fake_kmem_cpu *kc;
+	struct fake_kmem_mag *mag;
+	unsigned long flags;
+	int class;
+
+	if (!p)
+		return;
+	slab = (void *) ((unsigned long) p & ~(KMEM_SLAB_SIZE - 1UL));
+	class = slab->class;
+	if (class < 0) {
+		free(slab);
+		return;
+	}
+	local_irq_save(flags);
+	kc = &fake_kmem_cpus[get_cpu()];
+	mag = kc->loaded[class];
+	if (unlikely(!mag || mag->nr == KMEM_MAG_SIZE)) {
+		fake_kmem_reload(kc, class, false);
+		mag = kc->loaded[class];
+	}
+	mag->objs[mag->nr++] = (void *) p;
+	kc->nr_free++;
+	local_irq_restore(flags);
+}
+
+#define kmalloc(size, flags) fake_kmalloc(size)
+#define kzalloc(size, flags) fake_kzalloc(size)
+
+/*
+ * Print, for each CPU, how many objects it allocated and freed, how many
+ * magazines it traded with the depots, and how many objects were too
+ * large for a size class. Then print the slabs and full magazines of
+ * each class that was used, and the statistics of its depot's lock.
+ */
+void fake_dump_kmem_stats(void)
+{
+	struct fake_kmem_depot *d;
+	struct fake_kmem_cpu *kc;
+	char name[32];
+	int cpu, class;
+
+	printf("Slab statistics (%d-object magazines, %d KB slabs):\n",
+	       KMEM_MAG_SIZE, KMEM_SLAB_SIZE >> 10);
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		kc = &fake_kmem_cpus[cpu];
+		printf("cpu %-4d alloc %10lu free %10lu depot %8lu large %8lu\n",
+		       cpu, kc->nr_alloc, kc->nr_free, kc->nr_depot,
+		       kc->nr_large);
+	}
+	for (class = 0; class < KMEM_CLASSES; class++) {
+		d = &fake_kmem_depots[class];
+		if (!d->nr_slabs)
+			continue;
+		printf("kmalloc-%-5d slabs %8lu full magazines %8lu\n",
+		       KMEM_MIN_SIZE << class, d->nr_slabs, d->nr_full);
+		snprintf(name, sizeof(name), "kmalloc-%d lock",
+			 KMEM_MIN_SIZE << class);
+		fake_print_lock_stats(name, &d->lock.stats);
+	}
+}
+
+#endif /* __FAKE_SLAB_H */
@@ -0,0 +1,283 @@
+/*
+ * Softirq emulation for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_SOFTIRQ_H
+#define __FAKE_SOFTIRQ_H
+
+/*
+ * Under Nidhugg, raise_softirq() sets a flag that the next irq_exit()
+ * on the CPU checks. Natively, each CPU has a mask of pending softirqs,
+ * which are handled as in the kernel's __do_softirq():
+ *
+ *  - On the way out of an interrupt, pending softirqs are handled inline,
+ *    unless the CPU's ksoftirqd is already running. The pending mask is
+ *    re-read and handled again as long as it is not empty, for at most
+ *    MAX_SOFTIRQ_RESTART passes and MAX_SOFTIRQ_TIME_US microseconds.
+ *    Whatever is left over after that is deferred to ksoftirqd.
+ *  - A softirq raised outside of interrupt context wakes up ksoftirqd.
+ *  - With -DSOFTIRQ_THREADED, softirqs are never handled inline, as with
+ *    threadirqs in the kernel: irq_exit() always defers to ksoftirqd.
+ *
+ * The ksoftirqd kthreads are per-CPU (smpboot) kthreads of the registry
+ * in fake_kthread.h, spawned when ksoftirqd is first needed. As in the
+ * kernel, need_resched() (see fake_sched.h) also cuts the restart loop
+ * short.
+ *
+ * Softirqs are not nested on a CPU: while a softirq is being handled on a
+ * CPU, in_softirq() holds there, and other attempts to handle softirqs on
+ * that CPU leave them pending.
+ */
+#ifndef MAX_SOFTIRQ_TIME_US
+# define MAX_SOFTIRQ_TIME_US 2000
+#endif
+#define MAX_SOFTIRQ_RESTART 10
+
+struct fake_softirq_cpu {
+	unsigned int pending;		/* Mask of pending softirqs */
+	int serving;			/* Softirqs are being handled */
+	int ksoftirqd_running;		/* ksoftirqd woken, not asleep yet */
+	u64 raised[NR_SOFTIRQS];	/* Time of the oldest pending raise */
+
+	/* Statistics */
+	unsigned long nr_inline;	/* Passes of __do_softirq() at irq_exit() */
+	unsigned long nr_thread;	/* Passes of __do_softirq() in ksoftirqd */
+	unsigned long nr_restart;	/* Restarts of the pending loop */
+	unsigned long nr_deferred;	/* Times work was left to ksoftirqd */
+	u64 inline_ns;			/* Time spent in softirqs at irq_exit() */
+	u64 thread_ns;			/* Time spent in softirqs in ksoftirqd */
+	unsigned long nr_lat;
+	u64 latency_ns;			/* Total time from raise to handling */
+	u64 max_latency_ns;
+	unsigned long nr_batches;	/* rcu_do_batch() calls that invoked any */
+	unsigned long nr_cbs;		/* Callbacks they invoked */
+	long max_batch;
+	unsigned long nr_cut;		/* Batches that left callbacks behind */
+	unsigned long nr_cut_resched;	/* ... with need_resched() set */
+} ____cacheline_aligned_in_smp;
+
+struct fake_softirq_cpu fake_softirq_cpus[NR_CPUS];
+static struct softirq_action softirq_vec[NR_SOFTIRQS];
+static struct task_struct *ksoftirqd[NR_CPUS];
+static int ksoftirqd_spawned;
+static int __thread fake_serving_softirq;
+
+void open_softirq(int nr, void (*action)(struct softirq_action *))
+{
+	softirq_vec[nr].action = action;
+}
+
+int fake_in_softirq(void)
+{
+	return READ_ONCE(fake_softirq_cpus[get_cpu()].serving);
+}
+
+bool fake_softirq_pending(void)
+{
+	return __atomic_load_n(&fake_softirq_cpus[get_cpu()].pending,
+			       __ATOMIC_RELAXED);
+}
+
+static int ksoftirqd_should_run(unsigned int cpu)
+{
+	struct fake_softirq_cpu *sc = &fake_softirq_cpus[cpu];
+
+	if (__atomic_load_n(&sc->pending, __ATOMIC_SEQ_CST))
+		return 1;
+	/* Going to sleep */
+	__atomic_store_n(&sc->ksoftirqd_running, 0, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+static void fake_do_softirq(int threaded);
+
+static void run_ksoftirqd(unsigned int cpu)
+{
+	fake_do_softirq(1);
+	cond_resched_rcu_qs();
+}
+
+static struct smp_hotplug_thread softirq_threads = {
+	.store			= &ksoftirqd,
+	.thread_should_run	= ksoftirqd_should_run,
+	.thread_fn		= run_ksoftirqd,
+	.thread_comm		= "ksoftirqd/%u",
+};
+
+static void wakeup_softirqd(void)
+{
+	struct fake_softirq_cpu *sc = &fake_softirq_cpus[get_cpu()];
+	struct task_struct *t;
+
+	if (!__atomic_exchange_n(&ksoftirqd_spawned, 1, __ATOMIC_SEQ_CST))
+		smpboot_register_percpu_thread(&softirq_threads);
+	__atomic_store_n(&sc->ksoftirqd_running, 1, __ATOMIC_SEQ_CST);
+	t = READ_ONCE(ksoftirqd[get_cpu()]);
+	if (t)
+		wake_up_process(t);
+}
+
+void raise_softirq(unsigned int nr)
+{
+	struct fake_softirq_cpu *sc = &fake_softirq_cpus[get_cpu()];
+	u64 none = 0;
+
+	__atomic_compare_exchange_n(&sc->raised[nr], &none, fake_clock_ns(),
+				    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	__atomic_fetch_or(&sc->pending, 1U << nr, __ATOMIC_SEQ_CST);
+	if (!fake_hardirq_count && !fake_serving_softirq)
+		wakeup_softirqd();
+}
+
+/*
+ * Handle the softirqs pending on the current CPU, either on the way out
+ * of an interrupt or from ksoftirqd.
+ */
+static void fake_do_softirq(int threaded)
+{
+	struct fake_softirq_cpu *sc = &fake_softirq_cpus[get_cpu()];
+	u64 start = fake_clock_ns();
+	u64 end = start + MAX_SOFTIRQ_TIME_US * 1000ULL;
+	int restart = MAX_SOFTIRQ_RESTART;
+	unsigned int pending;
+	u64 now, raised, lat;
+	int nr;
+
+	if (__atomic_exchange_n(&sc->serving, 1, __ATOMIC_SEQ_CST))
+		return;
+	fake_serving_softirq = 1;
+	if (threaded)
+		sc->nr_thread++;
+	else
+		sc->nr_inline++;
+
+	for (;;) {
+		pending = __atomic_exchange_n(&sc->pending, 0, __ATOMIC_SEQ_CST);
+		while (pending) {
+			nr = __builtin_ctz(pending);
+			pending &= pending - 1;
+			raised = __atomic_exchange_n(&sc->raised[nr], 0,
+						     __ATOMIC_RELAXED);
+			if (raised) {
+				lat = fake_clock_ns() - raised;
+				sc->nr_lat++;
+				sc->latency_ns += lat;
+				if (lat > sc->max_latency_ns)
+					sc->max_latency_ns = lat;
+			}
+			fake_kstat_softirqs[get_cpu()][nr]++;
+			softirq_vec[nr].action(&softirq_vec[nr]);
+		}
+		now = fake_clock_ns();
+		if (!__atomic_load_n(&sc->pending, __ATOMIC_SEQ_CST) ||
+		    now >= end || need_resched() || !--restart)
+			break;
+		sc->nr_restart++;
+	}
+
+	if (threaded)
+		sc->thread_ns += now - start;
+	else
+		sc->inline_ns += now - start;
+	fake_serving_softirq = 0;
+	__atomic_store_n(&sc->serving, 0, __ATOMIC_SEQ_CST);
+
+	/* Out of budget, or raised while we were done but still serving */
+	if (!threaded && __atomic_load_n(&sc->pending, __ATOMIC_SEQ_CST)) {
+		sc->nr_deferred++;
+		wakeup_softirqd();
+	}
+}
+
+/* Called from irq_exit() when softirqs are pending on the current CPU */
+void fake_invoke_softirq(void)
+{
+#ifdef SOFTIRQ_THREADED
+	wakeup_softirqd();
+#else
+	/* As in the kernel, let a running ksoftirqd do its job */
+	if (__atomic_load_n(&fake_softirq_cpus[get_cpu()].ksoftirqd_running,
+			    __ATOMIC_SEQ_CST))
+		return;
+	fake_do_softirq(0);
+#endif
+}
+
+/*
+ * Account a batch of callbacks invoked by rcu_do_batch() on this CPU,
+ * which stopped with callbacks left (cb) once it reached its limit, either
+ * because need_resched() held (nr) or because the CPU was not idle.
+ */
+void fake_batch_end(long count, bool cb, bool nr)
+{
+	struct fake_softirq_cpu *sc = &fake_softirq_cpus[get_cpu()];
+
+	if (!count)
+		return;
+	sc->nr_batches++;
+	sc->nr_cbs += count;
+	if (count > sc->max_batch)
+		sc->max_batch = count;
+	if (cb) {
+		sc->nr_cut++;
+		if (nr)
+			sc->nr_cut_resched++;
+	}
+}
+
+/*
+ * Print, for each CPU, how many times softirqs were handled at irq_exit()
+ * and in ksoftirqd, how often the pending loop restarted and ran out of
+ * budget, the average/maximum latency from raise to handling, and the
+ * share of the last elapsed_ns nanoseconds spent handling softirqs. Then
+ * print the average/maximum size of the callback batches, and how many of
+ * them were cut short, in total and because of need_resched().
+ */
+void fake_dump_softirq_stats(u64 elapsed_ns)
+{
+	struct fake_softirq_cpu *sc;
+	int cpu;
+
+	printf("Softirq statistics (%s, budget %d us):\n",
+#ifdef SOFTIRQ_THREADED
+	       "threaded",
+#else
+	       "inline",
+#endif
+	       MAX_SOFTIRQ_TIME_US);
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		sc = &fake_softirq_cpus[cpu];
+		printf("cpu %-4d inline %8lu ksoftirqd %8lu restart %8lu deferred %8lu lat %8llu/%8llu ns share %5.1f%%/%5.1f%%\n",
+		       cpu, sc->nr_inline, sc->nr_thread, sc->nr_restart,
+		       sc->nr_deferred,
+		       sc->nr_lat ? sc->latency_ns / sc->nr_lat : 0,
+		       sc->max_latency_ns,
+		       elapsed_ns ? 100.0 * sc->inline_ns / elapsed_ns : 0.0,
+		       elapsed_ns ? 100.0 * sc->thread_ns / elapsed_ns : 0.0);
+	}
+	printf("Callback batches (blimit %ld, qhimark %ld, qlowmark %ld):\n",
+	       blimit, qhimark, qlowmark);
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		sc = &fake_softirq_cpus[cpu];
+		printf("cpu %-4d batches %8lu size %8lu/%8ld cut %8lu resched %8lu\n",
+		       cpu, sc->nr_batches,
+		       sc->nr_batches ? sc->nr_cbs / sc->nr_batches : 0,
+		       sc->max_batch, sc->nr_cut, sc->nr_cut_resched);
+	}
+}
+
+#endif /* __FAKE_SOFTIRQ_H */
@@ -0,0 +1,722 @@
+/*
+ * "Fake" definitions to emulate some kernel synchronization mechanisms.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ *
+ * Author: Michalis Kokologiannakis <mixaskok@gmail.com>
+ */
+
+#ifndef __FAKE_SYNC_H
+#define __FAKE_SYNC_H
+
+#include <pthread.h>
+
+#ifdef NATIVE
+/*
+ * When running natively, raw_spinlock_t and spinlock_t are ticket
+ * spinlocks, so that contention on e.g. the rcu_node locks behaves like
+ * contention on kernel spinlocks and not like contention on sleeping
+ * mutexes. Each lock also keeps some statistics. These are only updated
+ * by the lock holder, so no atomic operations are needed for them.
+ */
+struct fake_lock_stats {
+	unsigned long acquired;		/* Total number of acquisitions. */
+	unsigned long contended;	/* Acquisitions that had to spin. */
+	u64 spin_ns;			/* Total time spent spinning. */
+};
+
+typedef struct {
+	union {
+		unsigned int slock;
+		struct {
+			unsigned short owner;	/* Ticket being served. */
+			unsigned short next;	/* Next ticket to hand out. */
+		} tickets;
+	};
+	struct fake_lock_stats stats;
+} raw_spinlock_t;
+#define __RAW_SPIN_LOCK_UNLOCKED(lockname) { { 0 } }
+
+typedef raw_spinlock_t spinlock_t;
+#define __SPIN_LOCK_UNLOCKED(lockname) { { 0 } }
+#define SPINLOCK_INITIALIZER { { 0 } }
+
+/*
+ * Spin this many times before yielding the host CPU, in case the lock
+ * holder has been preempted by the host (e.g., when there are more
+ * emulated CPUs than host CPUs). Fibers are never preempted, so a fiber
+ * whose lock holder runs on the same host thread has to yield at once.
+ */
+#ifndef FAKE_SPIN_YIELD
+# ifdef FIBERS
+#  define FAKE_SPIN_YIELD 1
+# else
+#  define FAKE_SPIN_YIELD 1000
+# endif
+#endif
+#else /* #ifdef NATIVE */
+/* 
+ * Fake datatypes for various synchronization mechanisms 
+ *
+ * raw_spinlock_t, spinlock_t, mutex_t are emulated using pthread_mutex_lock.
+ * In kernel, these are architecture-dependent types, with similar but not
+ * identical behaviour which can be modeled with pthread_mutex_lock.
+ */
+typedef pthread_mutex_t raw_spinlock_t;
+#define __RAW_SPIN_LOCK_UNLOCKED(lockname) PTHREAD_MUTEX_INITIALIZER
+
+typedef pthread_mutex_t spinlock_t;
+#define __SPIN_LOCK_UNLOCKED(lockname) PTHREAD_MUTEX_INITIALIZER
+#define SPINLOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#endif /* #ifdef NATIVE */
+
+struct mutex {
+	pthread_mutex_t lock;
+};
+#define __MUTEX_INITIALIZER(lockname) { .lock = PTHREAD_MUTEX_INITIALIZER }
+#define DEFINE_MUTEX(mutexname) struct mutex mutexname = \
+    __MUTEX_INITIALIZER(mutexname)
+
+struct rt_mutex {
+	pthread_mutex_t lock;
+};
+#define __RT_MUTEX_INITIALIZER(lockname) { .lock = PTHREAD_MUTEX_INITIALIZER }
+
+#ifdef NATIVE
+/*
+ * When running natively, a wait queue is a futex word which is bumped
+ * on every wakeup. A waiter samples it before checking its condition,
+ * so that a wakeup which races with the check is not lost.
+ */
+typedef struct __wait_queue_head {
+	unsigned int seq;
+} wait_queue_head_t;
+
+struct swait_queue_head {
+	unsigned int seq;
+};
+
+/*
+ * Waiters for a completion sleep on done itself, so that complete()
+ * does not have to write anything after done has been incremented.
+ */
+struct completion {
+	unsigned int          done;
+	wait_queue_head_t     wait;
+};
+#else /* #ifdef NATIVE */
+/*
+ * wait_queue_head_t and swait_queue_head are just empty structs. 
+ * Although wait queues can be also modeled with condition variables, 
+ * for our purposes, and due to the fact that Nidhugg uses the spin-assume 
+ * transformation, busy-waiting is sufficient.
+ */
+typedef struct __wait_queue_head {
+} wait_queue_head_t;
+
+struct swait_queue_head { };
+
+/*
+ * Since threads waiting on a waitqueue are just spinning, threads waiting
+ * for a completion will be spinning as well.
+ * done is declared volatile in order to prevent the compiler from optimizing
+ * the busy-loop.
+ */
+struct completion {
+	volatile unsigned int done;
+	wait_queue_head_t     wait;
+};
+#endif /* #ifdef NATIVE */
+
+#define DECLARE_WAIT_QUEUE_HEAD(waitqueuename) wait_queue_head_t waitqueuename
+
+
+#ifdef NATIVE
+/*
+ * Ticket-lock primitives. Spinning time is only measured when the lock
+ * is contended, so that the uncontended fast path stays cheap.
+ */
+static inline void fake_spin_acquire(raw_spinlock_t *l)
+{
+	unsigned short ticket;
+	u64 start;
+	int spins = 0;
+
+#ifdef SIMULATE
+	fake_sim_rmw(l);
+#endif
+	ticket = __atomic_fetch_add(&l->tickets.next, 1, __ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&l->tickets.owner, __ATOMIC_ACQUIRE) == ticket) {
+		l->stats.acquired++;
+		return;
+	}
+
+	start = fake_clock_ns();
+	while (__atomic_load_n(&l->tickets.owner, __ATOMIC_ACQUIRE) != ticket) {
+		if (++spins < FAKE_SPIN_YIELD) {
+			fake_cpu_relax();
+		} else {
+			spins = 0;
+			sched_yield();
+		}
+	}
+	l->stats.acquired++;
+	l->stats.contended++;
+	l->stats.spin_ns += fake_clock_ns() - start;
+}
+
+static inline int fake_spin_tryacquire(raw_spinlock_t *l)
+{
+	raw_spinlock_t old, new;
+
+#ifdef SIMULATE
+	fake_sim_rmw(l);
+#endif
+	old.slock = __atomic_load_n(&l->slock, __ATOMIC_RELAXED);
+	if (old.tickets.owner != old.tickets.next)
+		return 0;
+	new.slock = old.slock;
+	new.tickets.next++;
+	if (!__atomic_compare_exchange_n(&l->slock, &old.slock, new.slock, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+	l->stats.acquired++;
+	return 1;
+}
+
+static inline void fake_spin_release(raw_spinlock_t *l)
+{
+	__atomic_store_n(&l->tickets.owner, l->tickets.owner + 1,
+			 __ATOMIC_RELEASE);
+}
+
+/* 
+ * Raw-spinlock functions
+ */
+void raw_spin_lock_init(raw_spinlock_t *l)
+{
+	memset(l, 0, sizeof(*l));
+}
+
+void fake_raw_spin_lock_irqsave(raw_spinlock_t *l)
+{
+	fake_local_irq_save();
+	preempt_disable();
+	fake_spin_acquire(l);
+}
+/* As local_irq_save(), sets flags */
+#define raw_spin_lock_irqsave(l, flags) \
+	do { (flags) = 0; fake_raw_spin_lock_irqsave(l); } while (0)
+
+void raw_spin_unlock_irqrestore(raw_spinlock_t *l, unsigned long flags)
+{
+	fake_spin_release(l);
+	local_irq_restore(flags);
+	preempt_enable();
+}
+
+void raw_spin_lock_irq(raw_spinlock_t *l)
+{
+	local_irq_disable();
+	preempt_disable();
+	fake_spin_acquire(l);
+}
+
+void raw_spin_unlock_irq(raw_spinlock_t *l)
+{
+	fake_spin_release(l);
+	local_irq_enable();
+	preempt_enable();
+}
+
+void raw_spin_lock(raw_spinlock_t *l)
+{
+	preempt_disable();
+	fake_spin_acquire(l);
+}
+
+void raw_spin_unlock(raw_spinlock_t *l)
+{
+	fake_spin_release(l);
+	preempt_enable();
+}
+
+int raw_spin_trylock(raw_spinlock_t *l)
+{
+	preempt_disable();
+	if (!fake_spin_tryacquire(l)) {
+		preempt_enable();
+		return 0;
+	}
+	return 1;
+}
+
+
+/* 
+ * Spinlock functions
+ */
+void spin_lock_init(raw_spinlock_t *l)
+{
+	raw_spin_lock_init(l);
+}
+
+void spin_lock(spinlock_t *l)
+{
+	raw_spin_lock(l);
+}
+
+void spin_unlock(spinlock_t *l)
+{
+	raw_spin_unlock(l);
+}
+#else /* #ifdef NATIVE */
+/* 
+ * Raw-spinlock functions
+ */
+void raw_spin_lock_init(raw_spinlock_t *l)
+{
+	if (pthread_mutex_init(l, NULL))
+		exit(-1);
+}
+
+void raw_spin_lock_irqsave(raw_spinlock_t *l, unsigned long flags)
+{
+	local_irq_save(flags);
+	preempt_disable();
+	if (pthread_mutex_lock(l))
+		exit(-1);
+}
+
+void raw_spin_unlock_irqrestore(raw_spinlock_t *l, unsigned long flags)
+{
+	if (pthread_mutex_unlock(l))
+		exit(-1);
+	local_irq_restore(flags);
+	preempt_enable();
+}
+
+void raw_spin_lock_irq(raw_spinlock_t *l)
+{
+	local_irq_disable();
+	preempt_disable();
+	if (pthread_mutex_lock(l))
+		exit(-1);
+}
+
+void raw_spin_unlock_irq(raw_spinlock_t *l)
+{
+	if (pthread_mutex_unlock(l))
+		exit(-1);
+	local_irq_enable();
+	preempt_enable();
+}
+
+void raw_spin_lock(raw_spinlock_t *l)
+{
+	preempt_disable();
+	if (pthread_mutex_lock(l))
+		exit(-1);
+}
+
+void raw_spin_unlock(raw_spinlock_t *l)
+{
+	if (pthread_mutex_unlock(l))
+		exit(-1);
+	preempt_enable();
+}
+
+int raw_spin_trylock(raw_spinlock_t *l)
+{
+	preempt_disable();
+	if (pthread_mutex_trylock(l)) {
+		preempt_enable();
+		return 0;
+	}
+	return 1;
+}
+
+
+/* 
+ * Spinlock functions
+ */
+void spin_lock_init(raw_spinlock_t *l)
+{
+	if (pthread_mutex_init(l, NULL))
+		exit(-1);
+}
+
+void spin_lock(spinlock_t *l)
+{
+	preempt_disable();
+	if (pthread_mutex_lock(l))
+		exit(-1);
+}
+
+void spin_unlock(spinlock_t *l)
+{
+	if (pthread_mutex_unlock(l))
+		exit(-1);
+	preempt_enable();
+}
+#endif /* #ifdef NATIVE */
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 19, 0)
+/* Used by the trees before v3.19 to try for ->fqslock */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 0, 0)
+int raw_spin_trylock_irqsave(raw_spinlock_t *l, unsigned long flags)
+{
+	preempt_disable();
+	if (pthread_mutex_trylock(l)) {
+		preempt_enable();
+		return 0;
+	}
+	local_irq_save(flags);
+	return 1;
+}
+#endif
+
+int spin_trylock_irqsave(spinlock_t *l, unsigned long flags)
+{
+	preempt_disable();
+	if (pthread_mutex_trylock(l)) {
+		preempt_enable();
+		return 0;
+	}
+	local_irq_save(flags);
+	return 1;
+}
+#endif
+
+void spin_lock_irq(spinlock_t *lock)
+{
+	raw_spin_lock_irq(lock);
+}
+
+void spin_unlock_irq(spinlock_t *lock)
+{
+	raw_spin_unlock_irq(lock);
+}
+
+void spin_lock_irqsave(spinlock_t *lock, unsigned long flags)
+{
+	raw_spin_lock_irqsave(lock, flags);
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, unsigned long flags)
+{
+	raw_spin_unlock_irqrestore(lock, flags);
+}
+
+
+/* 
+ * Mutex functions
+ */
+void mutex_init(struct mutex *l)
+{
+  if (pthread_mutex_init(&l->lock, NULL))
+		exit(-1);
+}
+
+#ifdef NATIVE
+/*
+ * As in the kernel, a task that blocks on a mutex sleeps, i.e., gives up
+ * its CPU until it gets the mutex. Otherwise, its CPU would never pass
+ * through a quiescent state, and a grace period that the mutex holder
+ * waits for (e.g., an expedited one under ->exp_mutex) would never end.
+ */
+void mutex_lock(struct mutex *l)
+{
+#ifdef SIMULATE
+	fake_sim_rmw(l);
+#endif
+	if (!pthread_mutex_trylock(&l->lock))
+		return;
+	fake_release_cpu(get_cpu());
+	if (pthread_mutex_lock(&l->lock))
+		exit(-1);
+	fake_acquire_cpu(get_cpu());
+}
+#else /* #ifdef NATIVE */
+void mutex_lock(struct mutex *l)
+{
+	if (pthread_mutex_lock(&l->lock))
+		exit(-1);
+}
+#endif /* #ifdef NATIVE */
+
+void mutex_unlock(struct mutex *l)
+{
+	if (pthread_mutex_unlock(&l->lock))
+		exit(-1);
+}
+
+int mutex_trylock(struct mutex *l)
+{
+	if (pthread_mutex_trylock(&l->lock)) {
+		return 0;
+	}
+	return 1;
+}
+
+int mutex_is_locked(struct mutex *l)
+{
+	if (mutex_trylock(l)) {
+		mutex_unlock(l);
+		return 0;
+	}
+	else
+		return 1;
+}
+
+
+/* 
+ * Waitqueue functions
+ */
+#ifdef NATIVE
+# define init_waitqueue_head(wait_queue_head) ((wait_queue_head)->seq = 0)
+# define init_swait_queue_head(wait_queue_head) ((wait_queue_head)->seq = 0)
+
+void fake_wake_up(unsigned int *seq, int nr)
+{
+	__atomic_add_fetch(seq, 1, __ATOMIC_SEQ_CST);
+	fake_futex_wake(seq, nr);
+}
+
+# define wake_up(wait_queue_head) fake_wake_up(&(wait_queue_head)->seq, INT_MAX)
+# define wake_up_all(wait_queue_head) wake_up(wait_queue_head)
+# define wake_up_locked(wait_queue_head) wake_up(wait_queue_head)
+# define swake_up(swait_queue_head) fake_wake_up(&(swait_queue_head)->seq, 1)
+# define swake_up_all(swait_queue_head) wake_up(swait_queue_head)
+# define swake_up_all_locked(swait_queue_head) wake_up(swait_queue_head)
+
+/*
+ * Sleep on w until condition holds. The CPU is released while sleeping,
+ * just like in the busy-waiting version below. Kthreads that are being
+ * stopped exit from here.
+ */
+# define fake_wait_event(w, condition)					\
+({									\
+	unsigned int __seq;						\
+									\
+	fake_release_cpu(get_cpu());					\
+	for (;;) {							\
+		__seq = __atomic_load_n(&(w).seq, __ATOMIC_SEQ_CST);	\
+		if (condition)						\
+			break;						\
+		if (kthread_should_stop())				\
+			fake_kthread_exit();				\
+		fake_kthread_wait(&(w).seq, __seq);			\
+	}								\
+	fake_acquire_cpu(get_cpu());					\
+})
+
+# define wait_event(w, condition)		\
+({					        \
+	if (!IS_ENABLED(IRQ_THREADS))		\
+		do_IRQ();			\
+	fake_wait_event(w, condition);		\
+})
+
+/*
+ * Sleep on w until condition holds or timeout jiffies elapse, whichever
+ * comes first. As in the kernel, return 0 if the timeout elapsed and the
+ * condition is still false, and the remaining jiffies (at least 1)
+ * otherwise.
+ */
+# define fake_wait_event_timeout(w, condition, timeout)			\
+({									\
+	struct fake_timer __t;						\
+	unsigned int __seq;						\
+	long __ret;							\
+	bool __cond;							\
+									\
+	fake_release_cpu(get_cpu());					\
+	fake_add_timer(&__t, (timeout), &(w).seq);			\
+	for (;;) {							\
+		__seq = __atomic_load_n(&(w).seq, __ATOMIC_SEQ_CST);	\
+		__cond = (condition);					\
+		if (__cond || __atomic_load_n(&__t.fired, __ATOMIC_SEQ_CST) || \
+		    kthread_should_stop())				\
+			break;						\
+		fake_kthread_wait(&(w).seq, __seq);			\
+	}								\
+	fake_del_timer(&__t);						\
+	if (kthread_should_stop())					\
+		fake_kthread_exit();					\
+	__ret = (long) (__t.expires - jiffies);				\
+	if (__cond && __ret < 1)					\
+		__ret = 1;						\
+	else if (!__cond)						\
+		__ret = 0;						\
+	fake_acquire_cpu(get_cpu());					\
+	__ret;								\
+})
+
+# define swait_event(w, condition) wait_event(w, condition)
+# define wait_event_interruptible(w, condition) wait_event(w, condition)
+# define swait_event_interruptible(w, condition) wait_event(w, condition)
+# define swait_event_timeout(w, condition, timeout)			\
+({									\
+	if (!IS_ENABLED(IRQ_THREADS))					\
+		do_IRQ();						\
+	fake_wait_event_timeout(w, condition, timeout);			\
+})
+
+# define wait_event_interruptible_timeout(w, condition, timeout)	\
+({									\
+        if (!IS_ENABLED(IRQ_THREADS))					\
+		do_IRQ();						\
+	if (IS_ENABLED(FORCE_FAILURE_4)) {				\
+		rcu_gp_fqs(&rcu_sched_state, true);			\
+		rcu_gp_fqs(&rcu_sched_state, false);			\
+	}								\
+	fake_wait_event_timeout(w, condition, timeout);			\
+})
+# define swait_event_interruptible_timeout(w, condition, timeout)	\
+	wait_event_interruptible_timeout(w, condition, timeout)
+#else /* #ifdef NATIVE */
+#define init_waitqueue_head(wait_queue_head) do { } while (0)
+#define init_swait_queue_head(wait_queue_head) do { } while (0)
+
+#define wake_up(wait_queue_head) do { } while (0)
+#define wake_up_all(wait_queue_head) do { } while (0)
+#define wake_up_locked(wait_queue_head) do { } while (0)
+#define swake_up(swait_queue_head) do { } while (0)
+#define swake_up_all(swait_queue_head) do { } while (0)
+#define swake_up_all_locked(swait_queue_head) do { } while (0)
+
+#define fake_wait_event(w, condition)		\
+({					        \
+	fake_release_cpu(get_cpu());		\
+	while (!(condition))			\
+		;				\
+	fake_acquire_cpu(get_cpu());		\
+})
+#define fake_wait_event_timeout(w, condition, timeout)	\
+({							\
+	fake_wait_event(w, condition);			\
+	1;						\
+})
+
+/*
+ * Where an interrupt is taken before waiting is part of what each tree
+ * has been verified with, so these keep their per-version placement.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0) && \
+    LINUX_VERSION_CODE < KERNEL_VERSION(4, 7, 0)
+#define wait_event(w, condition) fake_wait_event(w, condition)
+#else
+#define wait_event(w, condition)		\
+({					        \
+	if (!IS_ENABLED(IRQ_THREADS))		\
+		do_IRQ();			\
+	fake_wait_event(w, condition);		\
+})
+#endif
+#define swait_event(w, condition) wait_event(w, condition)
+
+#define wait_event_interruptible(w, condition)	\
+({					        \
+	if (!IS_ENABLED(IRQ_THREADS))		\
+		do_IRQ();			\
+	fake_wait_event(w, condition);		\
+})
+#define swait_event_interruptible(w, condition)	\
+	wait_event_interruptible(w, condition)
+#define swait_event_timeout(w, condition, timeout)			\
+({									\
+	if (!IS_ENABLED(IRQ_THREADS))					\
+		do_IRQ();						\
+	fake_wait_event_timeout(w, condition, timeout);			\
+})
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 7, 0)
+#define wait_event_interruptible_timeout(w, condition, timeout)	\
+({								        \
+        if (!IS_ENABLED(IRQ_THREADS))					\
+		do_IRQ();						\
+	if (IS_ENABLED(FORCE_FAILURE_4)) {				\
+		rcu_gp_fqs(&rcu_sched_state, true);			\
+		rcu_gp_fqs(&rcu_sched_state, false);			\
+	}								\
+	fake_wait_event_timeout(w, condition, timeout);			\
+})
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(3, 19, 0)
+#define wait_event_interruptible_timeout(w, condition, timeout)	\
+({								        \
+	if (IS_ENABLED(FORCE_FAILURE_4))				\
+		rcu_gp_fqs(&rcu_sched_state, RCU_SAVE_DYNTICK);		\
+	do_IRQ();							\
+	fake_wait_event_timeout(w, condition, timeout);			\
+})
+#else
+#define wait_event_interruptible_timeout(w, condition, timeout)	\
+({								        \
+	do_IRQ();							\
+	cond_resched();							\
+	do_IRQ();							\
+	fake_wait_event_timeout(w, condition, timeout);			\
+})
+#endif
+#define swait_event_interruptible_timeout(w, condition, timeout)	\
+	wait_event_interruptible_timeout(w, condition, timeout)
+#endif /* #ifdef NATIVE */
+
+
+/* 
+ * Completion functions
+ */
+void init_completion(struct completion *x)
+{
+        x->done = 0;
+        init_waitqueue_head(&x->wait);
+}
+
+#ifdef NATIVE
+void wait_for_completion(struct completion *x)
+{
+	might_sleep();
+
+	if (!IS_ENABLED(IRQ_THREADS))
+		do_IRQ();
+	fake_release_cpu(get_cpu());
+	while (!__atomic_load_n(&x->done, __ATOMIC_ACQUIRE))
+		fake_futex_wait(&x->done, 0);
+	fake_acquire_cpu(get_cpu());
+}
+
+void complete(struct completion *x)
+{
+	__atomic_add_fetch(&x->done, 1, __ATOMIC_RELEASE);
+	fake_futex_wake(&x->done, INT_MAX);
+}
+#else /* #ifdef NATIVE */
+void wait_for_completion(struct completion *x)
+{
+	might_sleep();
+
+        fake_release_cpu(get_cpu());
+	while (!x->done)
+		;
+	fake_acquire_cpu(get_cpu());
+}
+	
+void complete(struct completion *x)
+{
+	x->done++;
+}
+#endif /* #ifdef NATIVE */
+
+#endif /* __FAKE_SYNC_H */
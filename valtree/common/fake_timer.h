@@ -0,0 +1,169 @@
+/*
+ * Virtual jiffies clock and timer wheel for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_TIMER_H
+#define __FAKE_TIMER_H
+
+/*
+ * Under Nidhugg, jiffies never advance and all timeouts are ignored.
+ * Natively, a timekeeping thread advances jiffies in step with the host's
+ * monotonic clock, once every 1/HZ seconds, and expires the timers that
+ * back schedule_timeout() and the *_timeout() wait functions. That way,
+ * the FQS pacing of rcu_gp_kthread(), stall checks, and rcu_gp_slow()
+ * delays behave as they do in the kernel.
+ *
+ * Timers are kept in a simple (non-cascading) timer wheel: a timer is
+ * hashed to the slot of its expiry jiffy, and every slot is scanned when
+ * jiffies reach it. Timers that expire more than TIMER_WHEEL_SIZE jiffies
+ * in the future just stay in their slot for more than one revolution.
+ */
+#define TIMER_WHEEL_SIZE 256
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+
+/*
+ * A timer that wakes up a sleeping thread when it expires. If uaddr is
+ * set, it points to the futex word of a wait queue, which is bumped upon
+ * expiry. Otherwise, the sleeper waits on ->fired itself.
+ */
+struct fake_timer {
+	struct fake_timer *next;
+	struct fake_timer **pprev;
+	unsigned long expires;
+	unsigned int *uaddr;
+	unsigned int fired;
+};
+
+struct fake_timer *timer_wheel[TIMER_WHEEL_SIZE];
+pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void fake_wake_up(unsigned int *seq, int nr);
+
+/*
+ * Arm t so that it expires "timeout" jiffies from now. A timer with a
+ * timeout of zero expires at the next jiffy.
+ */
+void fake_add_timer(struct fake_timer *t, long timeout, unsigned int *uaddr)
+{
+	struct fake_timer **slot;
+
+	t->uaddr = uaddr;
+	t->fired = 0;
+	if (pthread_mutex_lock(&timer_lock))
+		exit(-1);
+	t->expires = jiffies + (timeout > 0 ? timeout : 1);
+	slot = &timer_wheel[t->expires & TIMER_WHEEL_MASK];
+	t->next = *slot;
+	if (t->next)
+		t->next->pprev = &t->next;
+	t->pprev = slot;
+	*slot = t;
+	if (pthread_mutex_unlock(&timer_lock))
+		exit(-1);
+}
+
+/*
+ * Disarm t if it has not expired yet. Upon return, the timer thread no
+ * longer references t, so it can safely go out of scope.
+ */
+void fake_del_timer(struct fake_timer *t)
+{
+	if (pthread_mutex_lock(&timer_lock))
+		exit(-1);
+	if (t->pprev) {
+		*t->pprev = t->next;
+		if (t->next)
+			t->next->pprev = t->pprev;
+		t->pprev = NULL;
+	}
+	if (pthread_mutex_unlock(&timer_lock))
+		exit(-1);
+}
+
+/*
+ * Advance jiffies by one and expire the timers that became due. Called
+ * from the timekeeping thread only.
+ */
+static void fake_run_timers(void)
+{
+	struct fake_timer *t, *next;
+
+	if (pthread_mutex_lock(&timer_lock))
+		exit(-1);
+	jiffies++;
+	for (t = timer_wheel[jiffies & TIMER_WHEEL_MASK]; t; t = next) {
+		next = t->next;
+		if (time_before(jiffies, t->expires))
+			continue;
+		*t->pprev = next;
+		if (next)
+			next->pprev = t->pprev;
+		t->pprev = NULL;
+		__atomic_store_n(&t->fired, 1, __ATOMIC_SEQ_CST);
+		if (t->uaddr)
+			fake_wake_up(t->uaddr, INT_MAX);
+		else
+			fake_futex_wake(&t->fired, 1);
+	}
+	if (pthread_mutex_unlock(&timer_lock))
+		exit(-1);
+}
+
+static void *fake_timekeeper(void *arg)
+{
+	u64 next = fake_clock_ns();
+
+	for (;;) {
+		next += 1000000000ULL / HZ;
+		fake_sleep_until(next);
+		fake_pin_housekeeping(0);
+		fake_run_timers();
+	}
+	return NULL;
+}
+
+/* The jiffies clock starts ticking before main() runs */
+__attribute__((constructor)) static void fake_timer_init(void)
+{
+	pthread_t t;
+
+	if (pthread_create(&t, NULL, fake_timekeeper, NULL))
+		abort();
+}
+
+/*
+ * Sleep for (at least) timeout jiffies. Just like a task that calls
+ * schedule_timeout() in the kernel, the calling thread gives up its CPU
+ * while sleeping. Kthreads that are being stopped exit from here.
+ */
+long fake_schedule_timeout(long timeout)
+{
+	struct fake_timer t;
+
+	fake_release_cpu(get_cpu());
+	fake_add_timer(&t, timeout, NULL);
+	while (!__atomic_load_n(&t.fired, __ATOMIC_SEQ_CST) &&
+	       !kthread_should_stop())
+		fake_kthread_wait(&t.fired, 0);
+	fake_del_timer(&t);
+	if (kthread_should_stop())
+		fake_kthread_exit();
+	fake_acquire_cpu(get_cpu());
+	return 0;
+}
+
+#endif /* __FAKE_TIMER_H */
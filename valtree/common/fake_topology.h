@@ -0,0 +1,291 @@
+/*
+ * Placement of the emulated CPUs on the host CPUs for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_TOPOLOGY_H
+#define __FAKE_TOPOLOGY_H
+
+#include <errno.h>
+
+/*
+ * With -DPIN_CPUS, every host thread that runs on behalf of an emulated
+ * CPU (the task holding its cpu_lock, and its IRQ thread) is pinned to
+ * the host CPU of that emulated CPU, so that the host scheduler does not
+ * migrate the emulation around and the run-to-run variation stays small.
+ *
+ * The host CPUs that the process may run on are ordered by socket and
+ * core, with the first hardware thread of every core coming before any
+ * SMT sibling, so that two emulated CPUs only share a core once every
+ * core has one. The emulated CPUs are then laid out in this order, one
+ * rcu_node leaf after the other: a leaf that would straddle two sockets
+ * starts on the cores of the next one instead (rather than on the SMT
+ * siblings of the first one), so that the CPUs which report their
+ * quiescent states to the same leaf share a socket, just as they would
+ * in the kernel. If there are more emulated CPUs than host CPUs, the
+ * layout wraps around. The host CPUs left over, if any, run the
+ * timekeeper and the NMI injector; otherwise, those float.
+ *
+ * The layout follows the rcu_node geometry, so it is only set up once
+ * rcu_init() has run; threads that start earlier are pinned once they
+ * next acquire their CPU. With -DFIBERS, the host threads that run the
+ * fibers are pinned to the first host CPUs in the above order instead.
+ *
+ * With -DPIN_FIFO=prio, pinned threads also run with the SCHED_FIFO
+ * policy at priority prio. All of them get the same priority: a spinning
+ * thread gives way with sched_yield(), which only lets threads of its own
+ * priority run. If the host does not permit SCHED_FIFO, a warning is
+ * printed once and the threads keep their normal policy.
+ */
+#define FAKE_MAX_HOST_CPUS 1024
+#define FAKE_CPU_BITS (8 * sizeof(unsigned long))
+
+struct fake_host_cpu {
+	int cpu;
+	int socket;
+	int core;
+	int sibling;		/* Position among the threads of its core */
+};
+
+static struct fake_host_cpu fake_host_cpus[FAKE_MAX_HOST_CPUS];
+static int fake_nr_host_cpus;
+static pthread_once_t fake_host_once = PTHREAD_ONCE_INIT;
+
+#ifndef FIBERS
+/* Index in fake_host_cpus[] of the host CPU of each emulated CPU */
+static int fake_cpu_host[NR_CPUS];
+/* The host CPUs from this index on are not used by emulated CPUs */
+static int fake_nr_used_host_cpus;
+static bool fake_cpu_host_ready;
+static pthread_once_t fake_cpu_host_once = PTHREAD_ONCE_INIT;
+
+/* The emulated CPU the calling thread is pinned for, or -1 */
+static int __thread fake_pinned_cpu = -1;
+#endif
+#ifdef PIN_FIFO
+static bool fake_fifo_failed;
+#endif
+
+static int fake_read_topology(int cpu, const char *name, int dflt)
+{
+	char path[96];
+	FILE *f;
+	int val;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	f = fopen(path, "r");
+	if (!f)
+		return dflt;
+	if (fscanf(f, "%d", &val) != 1)
+		val = dflt;
+	fclose(f);
+	return val;
+}
+
+static int fake_host_cpu_cmp(const void *a, const void *b)
+{
+	const struct fake_host_cpu *x = a, *y = b;
+
+	if (x->sibling != y->sibling)
+		return x->sibling - y->sibling;
+	if (x->socket != y->socket)
+		return x->socket - y->socket;
+	if (x->core != y->core)
+		return x->core - y->core;
+	return x->cpu - y->cpu;
+}
+
+/* Find the host CPUs we may run on, and order them as described above */
+static void fake_probe_host_cpus(void)
+{
+	unsigned long mask[FAKE_MAX_HOST_CPUS / FAKE_CPU_BITS];
+	struct fake_host_cpu *h;
+	long len;
+	int cpu, i;
+
+	memset(mask, 0, sizeof(mask));
+	len = syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask);
+	if (len <= 0)
+		abort();
+	for (cpu = 0; cpu < len * 8; cpu++) {
+		if (!(mask[cpu / FAKE_CPU_BITS] & (1UL << cpu % FAKE_CPU_BITS)))
+			continue;
+		h = &fake_host_cpus[fake_nr_host_cpus++];
+		h->cpu = cpu;
+		h->socket = fake_read_topology(cpu, "physical_package_id", 0);
+		h->core = fake_read_topology(cpu, "core_id", cpu);
+		h->sibling = 0;
+		for (i = 0; i < fake_nr_host_cpus - 1; i++)
+			if (fake_host_cpus[i].socket == h->socket &&
+			    fake_host_cpus[i].core == h->core)
+				h->sibling++;
+	}
+	qsort(fake_host_cpus, fake_nr_host_cpus, sizeof(fake_host_cpus[0]),
+	      fake_host_cpu_cmp);
+}
+
+#ifndef FIBERS
+/* The end of the run of host CPUs in the same socket as the i-th one */
+static int fake_host_socket_end(int i)
+{
+	int j = i;
+
+	while (j < fake_nr_host_cpus &&
+	       fake_host_cpus[j].socket == fake_host_cpus[i].socket &&
+	       fake_host_cpus[j].sibling == fake_host_cpus[i].sibling)
+		j++;
+	return j;
+}
+
+/* Lay the emulated CPUs out, one rcu_node leaf at a time */
+static void fake_map_cpus(void)
+{
+	struct rcu_state *rsp = &rcu_sched_state;
+	struct rcu_node *rnp;
+	int cpu, end, n, size, pos = 0;
+
+	pthread_once(&fake_host_once, fake_probe_host_cpus);
+	n = fake_nr_host_cpus;
+	rcu_for_each_leaf_node(rsp, rnp) {
+		size = rnp->grphi - rnp->grplo + 1;
+		end = pos < n ? fake_host_socket_end(pos) : n;
+		if (pos + size > end && end < n &&
+		    fake_host_cpus[end].sibling == fake_host_cpus[pos].sibling &&
+		    fake_host_socket_end(end) - end >= size)
+			pos = end;
+		for (cpu = rnp->grplo; cpu <= rnp->grphi; cpu++)
+			fake_cpu_host[cpu] = pos++ % n;
+	}
+	fake_nr_used_host_cpus = pos < n ? pos : n;
+	__atomic_store_n(&fake_cpu_host_ready, true, __ATOMIC_RELEASE);
+}
+
+/*
+ * Returns false until rcu_init() has set up the rcu_node geometry, at
+ * which point the root rcu_node covers all CPUs.
+ */
+static bool fake_cpu_host_map(void)
+{
+	if (likely(__atomic_load_n(&fake_cpu_host_ready, __ATOMIC_ACQUIRE)))
+		return true;
+	if (READ_ONCE(rcu_sched_state.node[0].grphi) != nr_cpu_ids - 1)
+		return false;
+	pthread_once(&fake_cpu_host_once, fake_map_cpus);
+	return true;
+}
+#endif /* #ifndef FIBERS */
+
+/* Pin the calling thread to the i-th host CPU, or let it float if i < 0 */
+static void fake_pin_host(int i)
+{
+	unsigned long mask[FAKE_MAX_HOST_CPUS / FAKE_CPU_BITS];
+	int cpu;
+#ifdef PIN_FIFO
+	struct sched_param sp = { .sched_priority = PIN_FIFO };
+	int err;
+#endif
+
+	memset(mask, 0, sizeof(mask));
+	if (i < 0) {
+		for (i = 0; i < fake_nr_host_cpus; i++) {
+			cpu = fake_host_cpus[i].cpu;
+			mask[cpu / FAKE_CPU_BITS] |= 1UL << cpu % FAKE_CPU_BITS;
+		}
+	} else {
+		cpu = fake_host_cpus[i].cpu;
+		mask[cpu / FAKE_CPU_BITS] |= 1UL << cpu % FAKE_CPU_BITS;
+	}
+	if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask))
+		abort();
+#ifdef PIN_FIFO
+	if (READ_ONCE(fake_fifo_failed))
+		return;
+	err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+	if (err && !__atomic_exchange_n(&fake_fifo_failed, true,
+					__ATOMIC_RELAXED))
+		fprintf(stderr, "SCHED_FIFO not permitted (%s), not using it\n",
+			strerror(err));
+#endif
+}
+
+#ifndef FIBERS
+/*
+ * Pin the calling thread to the host CPU of cpu. This is cheap if it
+ * already is, so it is done whenever a thread acquires its CPU.
+ */
+void fake_pin_cpu(int cpu)
+{
+	if (likely(fake_pinned_cpu == cpu) || !fake_cpu_host_map())
+		return;
+	fake_pin_host(fake_cpu_host[cpu]);
+	fake_pinned_cpu = cpu;
+}
+
+/* Pin the calling thread, which is the i-th housekeeping one */
+void fake_pin_housekeeping(int i)
+{
+	int n;
+
+	if (likely(fake_pinned_cpu != -1) || !fake_cpu_host_map())
+		return;
+	n = fake_nr_host_cpus - fake_nr_used_host_cpus;
+	fake_pin_host(n ? fake_nr_used_host_cpus + i % n : -1);
+	fake_pinned_cpu = NR_CPUS;
+}
+#else /* #ifndef FIBERS */
+/* Pin the calling host thread, which is the i-th fiber worker */
+void fake_pin_worker(int i)
+{
+	pthread_once(&fake_host_once, fake_probe_host_cpus);
+	fake_pin_host(i % fake_nr_host_cpus);
+}
+#endif /* #ifndef FIBERS */
+
+/* Print where the emulated CPUs (or the fiber workers) were placed */
+void fake_dump_topology(void)
+{
+	struct fake_host_cpu *h;
+	int i;
+
+	pthread_once(&fake_host_once, fake_probe_host_cpus);
+#ifdef PIN_FIFO
+	printf("Host topology (%d host CPUs, SCHED_FIFO priority %d%s):\n",
+	       fake_nr_host_cpus, PIN_FIFO,
+	       fake_fifo_failed ? " not permitted" : "");
+#else
+	printf("Host topology (%d host CPUs):\n", fake_nr_host_cpus);
+#endif
+#ifdef FIBERS
+	for (i = 0; i < fake_fiber_nr_workers; i++) {
+		h = &fake_host_cpus[i % fake_nr_host_cpus];
+		printf("worker %-3d host %4d socket %2d core %4d thread %d\n",
+		       i, h->cpu, h->socket, h->core, h->sibling);
+	}
+#else
+	if (!fake_cpu_host_map())
+		return;
+	for (i = 0; i < NR_CPUS; i++) {
+		h = &fake_host_cpus[fake_cpu_host[i]];
+		printf("cpu %-4d host %4d socket %2d core %4d thread %d\n",
+		       i, h->cpu, h->socket, h->core, h->sibling);
+	}
+	for (i = fake_nr_used_host_cpus; i < fake_nr_host_cpus; i++)
+		printf("housekeeping host %4d\n", fake_host_cpus[i].cpu);
+#endif
+}
+
+#endif /* __FAKE_TOPOLOGY_H */
@@ -0,0 +1,380 @@
+/*
+ * Workqueue emulation for native runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ */
+
+#ifndef __FAKE_WORKQUEUE_H
+#define __FAKE_WORKQUEUE_H
+
+/*
+ * Under Nidhugg, work items are never executed. Natively, they are run
+ * by pools of worker threads, as in the kernel: there is one pool per
+ * CPU, whose workers run on that CPU, and one unbound pool, whose workers
+ * are spread over all CPUs. Each pool has a FIFO queue of pending work
+ * items and lazily spawns up to WQ_MAX_WORKERS workers, a new one
+ * whenever work is queued while no worker is idle. A worker holds the
+ * CPU lock of its CPU while it executes a work item, just like any other
+ * task running on that CPU.
+ *
+ * Every work item queued on a pool gets a sequence number. Flushing waits
+ * until the oldest work item that is still pending or running on the pool
+ * is younger than the one being flushed.
+ */
+#ifndef WQ_MAX_WORKERS
+# define WQ_MAX_WORKERS 4
+#endif
+
+#define WQ_UNBOUND		(1 << 1)
+#define WORK_CPU_UNBOUND	NR_CPUS
+
+struct worker_pool;
+
+struct work_struct {
+	struct work_struct *next;
+	work_func_t func;
+	struct worker_pool *pool;	/* Pool it was last queued on */
+	unsigned long seq;		/* Sequence number in that pool */
+	u64 queued;			/* Time at which it was queued */
+	int pending;
+};
+
+struct workqueue_struct {
+	const char *name;
+	unsigned int flags;
+};
+
+struct worker {
+	struct worker_pool *pool;
+	int cpu;
+	struct work_struct *current_work;
+	unsigned long current_seq;
+};
+
+struct worker_pool {
+	pthread_mutex_t lock;
+	int cpu;			/* -1 for the unbound pool */
+	struct work_struct *head;
+	struct work_struct **tail;
+	unsigned long queued_seq;	/* Sequence number of the last item */
+	unsigned int more_work;		/* Bumped when work gets queued */
+	unsigned int work_done;		/* Bumped when a work item is done */
+	int nr_workers;
+	int nr_idle;
+	struct worker workers[WQ_MAX_WORKERS];
+
+	/* Statistics */
+	unsigned long nr_queued;
+	unsigned long nr_executed;
+	int depth;
+	int max_depth;
+	u64 latency_ns;			/* Total time from queueing to start */
+	u64 max_latency_ns;
+	u64 exec_ns;			/* Total time spent executing */
+};
+
+struct worker_pool cpu_worker_pools[NR_CPUS];
+struct worker_pool unbound_pool;
+
+struct workqueue_struct fake_system_wq = { "events", 0 };
+struct workqueue_struct fake_system_unbound_wq = { "events_unbound",
+						   WQ_UNBOUND };
+struct workqueue_struct *system_wq = &fake_system_wq;
+struct workqueue_struct *system_unbound_wq = &fake_system_unbound_wq;
+
+#define INIT_WORK(_work, _func)						\
+	do {								\
+		memset((_work), 0, sizeof(*(_work)));			\
+		(_work)->func = (_func);				\
+	} while (0)
+#define INIT_WORK_ONSTACK(_work, _func) INIT_WORK(_work, _func)
+#define destroy_work_on_stack(_work) do { } while (0)
+
+static void fake_init_pool(struct worker_pool *pool, int cpu)
+{
+	if (pthread_mutex_init(&pool->lock, NULL))
+		abort();
+	pool->cpu = cpu;
+	pool->tail = &pool->head;
+}
+
+__attribute__((constructor)) static void fake_workqueue_init(void)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < NR_CPUS; cpu++)
+		fake_init_pool(&cpu_worker_pools[cpu], cpu);
+	fake_init_pool(&unbound_pool, -1);
+}
+
+/*
+ * Sequence number of the oldest work item that is either pending or
+ * running on pool, or of the next one to be queued if there is none.
+ * Called with the pool's lock held.
+ */
+static unsigned long fake_pool_oldest(struct worker_pool *pool)
+{
+	unsigned long oldest = pool->head ? pool->head->seq :
+					    pool->queued_seq + 1;
+	int i;
+
+	for (i = 0; i < pool->nr_workers; i++)
+		if (pool->workers[i].current_work &&
+		    pool->workers[i].current_seq < oldest)
+			oldest = pool->workers[i].current_seq;
+	return oldest;
+}
+
+static void *fake_worker_thread(void *arg)
+{
+	struct worker *worker = arg;
+	struct worker_pool *pool = worker->pool;
+	struct work_struct *work;
+	work_func_t func;
+	unsigned int more;
+	u64 start, lat;
+
+	set_cpu(worker->cpu);
+
+	if (pthread_mutex_lock(&pool->lock))
+		exit(-1);
+	pool->nr_idle--;
+	for (;;) {
+		while (!pool->head) {
+			pool->nr_idle++;
+			more = pool->more_work;
+			if (pthread_mutex_unlock(&pool->lock))
+				exit(-1);
+			fake_futex_wait(&pool->more_work, more);
+			if (pthread_mutex_lock(&pool->lock))
+				exit(-1);
+			pool->nr_idle--;
+		}
+
+		/*
+		 * As in the kernel, the work item may be requeued (or go
+		 * out of scope) as soon as its function has been called, so
+		 * it is not touched afterwards.
+		 */
+		work = pool->head;
+		pool->head = work->next;
+		if (!pool->head)
+			pool->tail = &pool->head;
+		pool->depth--;
+		work->pending = 0;
+		worker->current_work = work;
+		worker->current_seq = work->seq;
+		func = work->func;
+		start = fake_clock_ns();
+		lat = start - work->queued;
+		pool->latency_ns += lat;
+		if (lat > pool->max_latency_ns)
+			pool->max_latency_ns = lat;
+		if (pthread_mutex_unlock(&pool->lock))
+			exit(-1);
+
+		fake_acquire_cpu(get_cpu());
+		func(work);
+		fake_release_cpu(get_cpu());
+
+		if (pthread_mutex_lock(&pool->lock))
+			exit(-1);
+		pool->exec_ns += fake_clock_ns() - start;
+		pool->nr_executed++;
+		worker->current_work = NULL;
+		pool->work_done++;
+		fake_futex_wake(&pool->work_done, INT_MAX);
+	}
+	return NULL;
+}
+
+/*
+ * Called with the pool's lock held. The new worker counts as idle until
+ * it first takes the lock.
+ */
+static void fake_create_worker(struct worker_pool *pool)
+{
+	struct worker *worker = &pool->workers[pool->nr_workers];
+	pthread_t t;
+
+	worker->pool = pool;
+	worker->cpu = pool->cpu >= 0 ? pool->cpu :
+				       pool->nr_workers % nr_cpu_ids;
+	if (pthread_create(&t, NULL, fake_worker_thread, worker))
+		abort();
+	pool->nr_workers++;
+	pool->nr_idle++;
+}
+
+/*
+ * Queue work on the pool of the specified CPU, or on the unbound pool
+ * if wq is unbound. Returns false if work was already pending.
+ */
+bool queue_work_on(int cpu, struct workqueue_struct *wq,
+		   struct work_struct *work)
+{
+	struct worker_pool *pool;
+
+	if ((wq->flags & WQ_UNBOUND) || cpu == WORK_CPU_UNBOUND)
+		pool = &unbound_pool;
+	else
+		pool = &cpu_worker_pools[cpu];
+
+	if (pthread_mutex_lock(&pool->lock))
+		exit(-1);
+	if (work->pending) {
+		if (pthread_mutex_unlock(&pool->lock))
+			exit(-1);
+		return false;
+	}
+	work->pending = 1;
+	work->next = NULL;
+	work->pool = pool;
+	work->seq = ++pool->queued_seq;
+	work->queued = fake_clock_ns();
+	*pool->tail = work;
+	pool->tail = &work->next;
+	pool->nr_queued++;
+	if (++pool->depth > pool->max_depth)
+		pool->max_depth = pool->depth;
+	if (!pool->nr_idle && pool->nr_workers < WQ_MAX_WORKERS)
+		fake_create_worker(pool);
+	pool->more_work++;
+	if (pthread_mutex_unlock(&pool->lock))
+		exit(-1);
+	fake_futex_wake(&pool->more_work, 1);
+	return true;
+}
+
+/* As in the kernel, per-CPU workqueues prefer the local CPU */
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+	return queue_work_on(get_cpu(), wq, work);
+}
+
+bool schedule_work(struct work_struct *work)
+{
+	return queue_work(system_wq, work);
+}
+
+bool schedule_work_on(int cpu, struct work_struct *work)
+{
+	return queue_work_on(cpu, system_wq, work);
+}
+
+/*
+ * Wait until every work item queued on pool up to (and including)
+ * sequence number seq has finished executing.
+ */
+static void fake_flush_pool(struct worker_pool *pool, unsigned long seq)
+{
+	unsigned int done;
+
+	if (pthread_mutex_lock(&pool->lock))
+		exit(-1);
+	while (fake_pool_oldest(pool) <= seq) {
+		done = pool->work_done;
+		if (pthread_mutex_unlock(&pool->lock))
+			exit(-1);
+		fake_futex_wait(&pool->work_done, done);
+		if (pthread_mutex_lock(&pool->lock))
+			exit(-1);
+	}
+	if (pthread_mutex_unlock(&pool->lock))
+		exit(-1);
+}
+
+/*
+ * Wait for the last queueing instance of work to finish executing.
+ * Returns false if work was idle to begin with.
+ */
+bool flush_work(struct work_struct *work)
+{
+	struct worker_pool *pool = work->pool;
+	unsigned long seq = 0;
+	int i;
+
+	if (!pool)
+		return false;
+	if (pthread_mutex_lock(&pool->lock))
+		exit(-1);
+	if (work->pending)
+		seq = work->seq;
+	for (i = 0; i < pool->nr_workers; i++)
+		if (pool->workers[i].current_work == work &&
+		    pool->workers[i].current_seq > seq)
+			seq = pool->workers[i].current_seq;
+	if (pthread_mutex_unlock(&pool->lock))
+		exit(-1);
+	if (!seq)
+		return false;
+	fake_flush_pool(pool, seq);
+	return true;
+}
+
+/* Wait for all the work items queued on wq so far to finish executing */
+void flush_workqueue(struct workqueue_struct *wq)
+{
+	struct worker_pool *pool;
+	unsigned long seq;
+	int cpu;
+
+	for (cpu = 0; cpu <= NR_CPUS; cpu++) {
+		pool = cpu < NR_CPUS ? &cpu_worker_pools[cpu] : &unbound_pool;
+		if ((wq->flags & WQ_UNBOUND) && pool != &unbound_pool)
+			continue;
+		if (pthread_mutex_lock(&pool->lock))
+			exit(-1);
+		seq = pool->queued_seq;
+		if (pthread_mutex_unlock(&pool->lock))
+			exit(-1);
+		fake_flush_pool(pool, seq);
+	}
+}
+
+#define flush_scheduled_work() flush_workqueue(system_wq)
+
+static void fake_print_pool_stats(const char *name, struct worker_pool *pool)
+{
+	unsigned long n = pool->nr_executed;
+
+	printf("%-10s workers %d queued %8lu done %8lu depth %4d lat %8llu/%8llu ns exec %8llu ns\n",
+	       name, pool->nr_workers, pool->nr_queued, n, pool->max_depth,
+	       n ? pool->latency_ns / n : 0, pool->max_latency_ns,
+	       n ? pool->exec_ns / n : 0);
+}
+
+/*
+ * Print, for each pool that has been used, how many work items were
+ * queued and executed, the maximum queue depth, the average/maximum
+ * queueing latency and the average execution time.
+ */
+void fake_dump_workqueue_stats(void)
+{
+	char name[16];
+	int cpu;
+
+	printf("Workqueue statistics:\n");
+	for (cpu = 0; cpu < NR_CPUS; cpu++) {
+		if (!cpu_worker_pools[cpu].nr_queued)
+			continue;
+		sprintf(name, "cpu %d", cpu);
+		fake_print_pool_stats(name, &cpu_worker_pools[cpu]);
+	}
+	if (unbound_pool.nr_queued)
+		fake_print_pool_stats("unbound", &unbound_pool);
+}
+
+#endif /* __FAKE_WORKQUEUE_H */
@@ -19,6 +19,56 @@
 # Author: Michalis Kokologiannakis <mixaskok@gmail.com>
 
 unroll=5
+# Number of parts to split each verification into, which are explored in
+# parallel (see PARTITIONS in common/fake_sched.h)
+partitions=${PARTITIONS:-1}
+out=${TMPDIR:-/tmp}/rcu-nidhugg.$$
+
+trap 'rm -f ${out}.*' EXIT
+
+# nidhugg <kernel_version> <memory_model> <source_file> CFLAGS
+#
+# Run Nidhugg on <source_file>, as runfailure and runsuccess describe. If
+# ${partitions} is more than 1, verify each of the ${partitions} parts
+# of the executions in parallel, and fail if any of them fails. Tests that
+# do not emulate CPUs with fake_sched.h cannot be split.
+nidhugg() {
+    k_version=$1
+    mem_model=$2
+    test_file=$3
+    shift 3
+
+    if test ${partitions} -le 1 || ! grep -q fake_sched.h ${test_file}
+    then
+	nidhuggc -I${k_version} -std=gnu99 $* -- --${mem_model}  \
+		--extfun-no-race=fprintf --extfun-no-race=memcpy \
+		--print-progress-estimate --disable-mutex-init-requirement \
+		--unroll=${unroll} ${test_file}
+	return
+    fi
+    pids=
+    k=0
+    while test $k -lt ${partitions}
+    do
+	nidhuggc -I${k_version} -std=gnu99 -DPARTITIONS=${partitions} \
+		-DPARTITION=$k $* -- --${mem_model}  \
+		--extfun-no-race=fprintf --extfun-no-race=memcpy \
+		--print-progress-estimate --disable-mutex-init-requirement \
+		--unroll=${unroll} ${test_file} > ${out}.$k 2>&1 &
+	pids="${pids} $!"
+	k=`expr $k + 1`
+    done
+    status=0
+    k=0
+    for pid in ${pids}
+    do
+	wait ${pid} || status=1
+	echo "--- Part $k of ${partitions}:"
+	cat ${out}.$k
+	k=`expr $k + 1`
+    done
+    return ${status}
+}
 
 # runfailure <kernel_version> <memory_model> <source_file> CFLAGS
 #
@@ -37,10 +87,7 @@ runfailure() {
     echo '--- Preparing to run tests on kernel' ${k_version} under ${mem_model}
     echo '--- Expecting verification failure'
     echo '--------------------------------------------------------------------'
-    if nidhuggc -I${k_version} -std=gnu99 $* -- --${mem_model}  \
-		--extfun-no-race=fprintf --extfun-no-race=memcpy \
-		--print-progress-estimate --disable-mutex-init-requirement \
-		--unroll=${unroll} ${test_file}
+    if nidhugg ${k_version} ${mem_model} ${test_file} $*
     then
 	echo '^^^ Unexpected verification success'
 	failure=1
@@ -64,10 +111,7 @@ runsuccess() {
     echo '--- Preparing to run tests on kernel' ${k_version} under ${mem_model}
     echo '--- Expecting verification success'
     echo '--------------------------------------------------------------------'
-    if nidhuggc -I${k_version} -std=gnu99 $* -- --${mem_model}  \
-		--extfun-no-race=fprintf --extfun-no-race=memcpy \
-		--print-progress-estimate --disable-mutex-init-requirement \
-		--unroll=${unroll} ${test_file}
+    if nidhugg ${k_version} ${mem_model} ${test_file} $*
     then
 	:
     else
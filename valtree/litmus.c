@@ -138,6 +138,9 @@ int main()
 	if (pthread_join(tu, NULL))
 		abort();
 	
+#ifdef PCT
+	fake_dump_pct_stats();
+#endif
 	BUG_ON(r_x == 0 && r_y == 1);
 	
 	return 0;
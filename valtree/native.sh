@@ -0,0 +1,214 @@
+#!/bin/sh
+
+# Driver script for running the RCU tests natively on the host.
+#
+# The tests are compiled with -DNATIVE, which makes the emulation layer
+# sleep instead of busy-waiting, and are executed directly. Native runs
+# only explore a single interleaving per execution, so they are not a
+# replacement for driver.sh; they are meant for sanity-checking the
+# native mode and for taking performance measurements.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, you can access it online at
+# http://www.gnu.org/licenses/gpl-2.0.html.
+
+CC=${CC:-gcc}
+# As in the kernel, type-punning in READ_ONCE()/WRITE_ONCE() requires
+# -fno-strict-aliasing, and -Wunused-but-set-variable is off, since the
+# RCU trees set variables that they do not use. Any other warning counts
+# as a compilation failure.
+CFLAGS="-O2 -fno-strict-aliasing -std=gnu99 -DNATIVE"
+CFLAGS="${CFLAGS} -Wall -Wno-unused-but-set-variable"
+# Seconds after which a run is considered hung
+tmout=60
+runs=10
+bin=${TMPDIR:-/tmp}/rcu-native.$$
+
+trap 'rm -f ${bin} ${bin}.log ${bin}.trace ${bin}.replay' EXIT
+
+# compile <kernel_version> <source_file> CFLAGS
+#
+# Compile <source_file> natively against Linux kernel version
+# <kernel_version> into ${bin}, and fail if the compiler has anything to
+# say. Additional arguments will be passed to the compiler.
+compile() {
+    k_version=$1
+    test_file=$2
+    shift 2
+
+    if ! ${CC} -I${k_version} ${CFLAGS} $* -o ${bin} ${test_file} -pthread \
+	 > ${bin}.log 2>&1 || test -s ${bin}.log
+    then
+	cat ${bin}.log
+	echo '^^^ Compilation failure'
+	failure=1
+	return 1
+    fi
+}
+
+# runnative <kernel_version> <expect> <source_file> CFLAGS
+#
+# Compile <source_file> natively against Linux kernel version
+# <kernel_version> and run it ${runs} times. If <expect> is "success",
+# every run has to exit successfully, otherwise every run has to fail.
+# Additional arguments will be passed to the compiler.
+runnative() {
+    k_version=$1
+    expect=$2
+    test_file=$3
+    shift 3
+
+    echo '--------------------------------------------------------------------'
+    echo '--- Running' ${test_file} $* natively on kernel ${k_version}
+    echo '--- Expecting' ${expect}
+    echo '--------------------------------------------------------------------'
+    compile ${k_version} ${test_file} $* || return
+    i=0
+    while test $i -lt ${runs}
+    do
+	if timeout ${tmout} ${bin} > /dev/null 2>&1
+	then
+	    result=success
+	else
+	    result=failure
+	fi
+	if test ${result} != ${expect}
+	then
+	    echo "^^^ Unexpected ${result} on run $i"
+	    failure=1
+	    return
+	fi
+	i=`expr $i + 1`
+    done
+}
+
+# runseed <seed> <kernel_version> <expect> <source_file> CFLAGS
+#
+# As runnative, with the PCT scheduler seeded by <seed>.
+runseed() {
+    PCT_SEED=$1
+    export PCT_SEED
+    shift
+    runnative $*
+    unset PCT_SEED
+}
+
+# runreplay <kernel_version> <source_file> CFLAGS
+#
+# Compile <source_file> natively with -DPCT, and, for ${runs} seeds,
+# record the schedule of a run and check that replaying it under another
+# seed makes the same decisions.
+runreplay() {
+    k_version=$1
+    test_file=$2
+    shift 2
+
+    echo '--------------------------------------------------------------------'
+    echo '--- Replaying' ${test_file} $* natively on kernel ${k_version}
+    echo '--------------------------------------------------------------------'
+    compile ${k_version} ${test_file} -DPCT $* || return
+    i=0
+    while test $i -lt ${runs}
+    do
+	PCT_SEED=$i PCT_RECORD=${bin}.trace timeout ${tmout} ${bin} \
+	    > /dev/null 2>&1
+	PCT_SEED=${runs} PCT_REPLAY=${bin}.trace PCT_RECORD=${bin}.replay \
+	    timeout ${tmout} ${bin} > /dev/null 2>&1
+	if test "`tail -n +2 ${bin}.trace`" != "`tail -n +2 ${bin}.replay`"
+	then
+	    echo "^^^ Replay diverged for seed $i"
+	    failure=1
+	    return
+	fi
+	i=`expr $i + 1`
+    done
+}
+
+# Grace-Period guarantee -- RCU tree litmus test
+runnative v4.9.6 success litmus.c -DIRQ_THREADS
+runnative v4.9.6 failure litmus.c -DIRQ_THREADS -DASSERT_0
+runnative v4.7 success litmus.c -DIRQ_THREADS
+runnative v4.3 success litmus.c -DIRQ_THREADS
+runnative v3.19 success litmus.c -DIRQ_THREADS
+runnative v3.19 failure litmus.c -DIRQ_THREADS -DASSERT_0
+runnative v4.9.6 success litmus.c
+runnative v4.9.6 failure litmus.c -DASSERT_0
+runnative v3.19 success litmus.c
+
+# Native benchmark -- only checks that it runs to completion
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_EXPEDITED
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_EXPEDITED -DBENCH_READERS=2
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_BH
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_HOTPLUG -DBENCH_READERS=1
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_FLOOD=1000
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_FLOOD=1000 -DSOFTIRQ_THREADED
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_FLOOD=1000 -DBENCH_KFREE -DKMEM_MAG_SIZE=8
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_NMI -DNMI_HZ=10000
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=256 \
+	  -DBENCH_LOOPS=1
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_NMI -DPIN_CPUS
+runnative v4.9.6 success litmus.c -DIRQ_THREADS -DPIN_CPUS -DPIN_FIFO
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_EXPEDITED -DBENCH_READERS=1 -DATOMIC_STATS
+runnative v3.19 success bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_EXPEDITED -DATOMIC_STATS
+runnative v4.9.6 success litmus.c -DIRQ_THREADS -DFIBERS
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DFIBERS -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_EXPEDITED -DBENCH_READERS=1 -DFIBER_WORKERS=2
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DFIBERS \
+	  -DCONFIG_NR_CPUS=1024 -DBENCH_LOOPS=1 -DBENCH_HOTPLUG -DBENCH_FLOOD=10
+runnative v4.9.6 success litmus.c -DIRQ_THREADS -DSIMULATE
+runnative v4.9.6 failure litmus.c -DIRQ_THREADS -DSIMULATE -DASSERT_0
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DSIMULATE \
+	  -DCONFIG_NR_CPUS=4096 -DCONFIG_RCU_FANOUT=8 -DCONFIG_RCU_FANOUT_LEAF=8 \
+	  -DBENCH_LOOPS=1 -DBENCH_FLOOD=10
+runnative v4.9.6 success litmus.c -DIRQ_THREADS -DPCT
+runnative v4.9.6 failure litmus.c -DIRQ_THREADS -DPCT -DFORCE_FAILURE_6
+runnative v3.19 success litmus.c -DIRQ_THREADS -DPCT -DPCT_DEPTH=5
+runseed 50 v4.9.6 failure litmus.c -DPCT -DFORCE_FAILURE_1
+runseed 50 v4.9.6 failure litmus.c -DPCT -DFORCE_FAILURE_2
+runseed 50 v4.9.6 failure litmus.c -DPCT -DFORCE_FAILURE_3
+runseed 204 v4.9.6 failure litmus.c -DPCT -DFORCE_FAILURE_4
+runseed 514 v4.9.6 failure litmus.c -DPCT -DFORCE_FAILURE_5 -DPCT_DEPTH=4
+runnative v4.9.6 success litmus.c -DPCT
+runnative v4.9.6 success bench.c -DIRQ_THREADS -DPCT -DCONFIG_NR_CPUS=4 \
+	  -DBENCH_LOOPS=10 -DBENCH_EXPEDITED -DBENCH_READERS=1
+runreplay v4.9.6 litmus.c -DIRQ_THREADS
+runreplay v4.9.6 litmus.c -DIRQ_THREADS -DFORCE_FAILURE_6
+runreplay v3.19 bench.c -DIRQ_THREADS -DCONFIG_NR_CPUS=4 -DBENCH_LOOPS=10 \
+	  -DBENCH_EXPEDITED
+
+
+if test -n "$failure"
+then
+    echo '--------------------------------------------------------------------'
+    echo '--- ' UNEXPECTED NATIVE RESULTS
+    echo '--------------------------------------------------------------------'
+    exit 1
+else
+    echo '--------------------------------------------------------------------'
+    echo '--- ' Native runs proceeded as expected
+    echo '--------------------------------------------------------------------'
+    exit 0
+fi
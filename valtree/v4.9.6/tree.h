@@ -132,7 +132,7 @@ struct rcu_dynticks {
 				    /* Last jiffy CBs were all advanced. */
 	int tick_nohz_enabled_snap; /* Previously seen value from sysfs. */
 #endif /* #ifdef CONFIG_RCU_FAST_NO_HZ */
-};
+} ____cacheline_aligned_percpu;
 
 /* RCU's kthread states for tracing. */
 #define RCU_KTHREAD_STOPPED  0
@@ -435,7 +435,7 @@ struct rcu_data {
 
 	int cpu;
 	struct rcu_state *rsp;
-};
+} ____cacheline_aligned_percpu;
 
 /* Values for nocb_defer_wakeup field in struct rcu_data. */
 #define RCU_NOGP_WAKE_NOT	0